@@ -0,0 +1,171 @@
+#!/bin/sh
+# Generate a synthetic ODK-shaped repository, for benchmarking purposes.
+#
+# The repository contains an edit file with CLASSES classes (each with
+# a label, a parent, and AXIOMS-2 additional axioms -- part_of
+# restrictions and synonyms, plus an equivalence axiom for one class
+# out of ten so that the reasoner has something to do), IMPORTS import
+# modules that the edit file imports, COMPONENTS component files with
+# textual definitions, a catalog, and a Makefile whose 'all' and 'test'
+# targets mimic those of a ODK-generated Makefile (merge, reason, relax,
+# reduce, base and OBO products, ROBOT report).
+
+usage() {
+    echo "Usage: $0 [-n NAME] [-c CLASSES] [-a AXIOMS] [-i IMPORTS] [-m COMPONENTS] [-s SEED] DIR"
+    exit $1
+}
+
+name=syn
+classes=1000
+axioms=4
+imports=2
+components=2
+seed=1
+while getopts n:c:a:i:m:s:h opt; do
+    case $opt in
+    n) name=$OPTARG ;;
+    c) classes=$OPTARG ;;
+    a) axioms=$OPTARG ;;
+    i) imports=$OPTARG ;;
+    m) components=$OPTARG ;;
+    s) seed=$OPTARG ;;
+    h) usage 0 ;;
+    *) usage 1 >&2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 1 ] || usage 1 >&2
+[ ! -e "$1" ] || { echo "$0: $1 already exists" >&2; exit 1; }
+
+ont=$1/src/ontology
+mkdir -p "$ont/imports" "$ont/components" "$ont/reports" || exit 1
+NAME=$(echo $name | tr a-z A-Z)
+
+awk -v name=$name -v NAME=$NAME -v classes=$classes -v axioms=$axioms \
+    -v imports=$imports -v components=$components -v seed=$seed -v dir="$ont" '
+function id(prefix, n) { return sprintf("obo:%s_%07d", prefix, n) }
+function header(file, iri) {
+    print "Prefix(obo:=<http://purl.obolibrary.org/obo/>)" > file
+    print "Prefix(owl:=<http://www.w3.org/2002/07/owl#>)" > file
+    print "Prefix(rdfs:=<http://www.w3.org/2000/01/rdf-schema#>)" > file
+    print "Prefix(oio:=<http://www.geneontology.org/formats/oboInOwl#>)" > file
+    print "Ontology(<http://purl.obolibrary.org/obo/" iri ">" > file
+}
+BEGIN {
+    srand(seed)
+    part_of = "obo:BFO_0000050"
+    per_import = int(classes / 10 / (imports > 0 ? imports : 1))
+    if ( per_import < 10 ) per_import = 10
+
+    # Import modules
+    catalog = dir "/catalog-v001.xml"
+    print "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>" > catalog
+    print "<catalog prefer=\"public\" xmlns=\"urn:oasis:names:tc:entity:xmlns:xml:catalog\">" > catalog
+    for ( k = 1; k <= imports; k++ ) {
+        file = dir "/imports/imp" k "_import.owl"
+        header(file, name "/imports/imp" k "_import.owl")
+        prefix = sprintf("IMP%d", k)
+        for ( n = 1; n <= per_import; n++ ) {
+            print "Declaration(Class(" id(prefix, n) "))" > file
+            print "AnnotationAssertion(rdfs:label " id(prefix, n) " \"imported class " k "." n "\")" > file
+            if ( n > 1 )
+                print "SubClassOf(" id(prefix, n) " " id(prefix, int(rand() * (n - 1)) + 1) ")" > file
+        }
+        print ")" > file
+        close(file)
+        print "  <uri name=\"http://purl.obolibrary.org/obo/" name "/imports/imp" k "_import.owl\" uri=\"imports/imp" k "_import.owl\"/>" > catalog
+    }
+
+    # Components
+    for ( k = 1; k <= components; k++ ) {
+        file = dir "/components/comp" k ".owl"
+        header(file, name "/components/comp" k ".owl")
+        for ( n = k; n <= classes; n += components )
+            print "AnnotationAssertion(obo:IAO_0000115 " id(NAME, n) " \"A synthetic class, number " n ".\")" > file
+        print ")" > file
+        close(file)
+        print "  <uri name=\"http://purl.obolibrary.org/obo/" name "/components/comp" k ".owl\" uri=\"components/comp" k ".owl\"/>" > catalog
+    }
+    print "</catalog>" > catalog
+
+    # Edit file
+    file = dir "/" name "-edit.owl"
+    header(file, name ".owl")
+    for ( k = 1; k <= imports; k++ )
+        print "Import(<http://purl.obolibrary.org/obo/" name "/imports/imp" k "_import.owl>)" > file
+    for ( k = 1; k <= components; k++ )
+        print "Import(<http://purl.obolibrary.org/obo/" name "/components/comp" k ".owl>)" > file
+    print "Declaration(ObjectProperty(" part_of "))" > file
+    print "AnnotationAssertion(rdfs:label " part_of " \"part of\")" > file
+    print "TransitiveObjectProperty(" part_of ")" > file
+    for ( n = 1; n <= classes; n++ ) {
+        c = id(NAME, n)
+        print "Declaration(Class(" c "))" > file
+        print "AnnotationAssertion(rdfs:label " c " \"" name " class " n "\")" > file
+        if ( n == 1 )
+            continue
+        if ( imports > 0 && rand() < 0.1 )
+            parent = id(sprintf("IMP%d", int(rand() * imports) + 1), int(rand() * per_import) + 1)
+        else
+            parent = id(NAME, int(rand() * (n - 1)) + 1)
+        filler = id(NAME, int(rand() * (n - 1)) + 1)
+        if ( n % 10 == 0 )
+            print "EquivalentClasses(" c " ObjectIntersectionOf(" parent " ObjectSomeValuesFrom(" part_of " " filler ")))" > file
+        else
+            print "SubClassOf(" c " " parent ")" > file
+        for ( a = 3; a <= axioms; a++ ) {
+            if ( a % 2 == 1 )
+                print "SubClassOf(" c " ObjectSomeValuesFrom(" part_of " " id(NAME, int(rand() * (n - 1)) + 1) "))" > file
+            else
+                print "AnnotationAssertion(oio:hasExactSynonym " c " \"synonym " a " of " name " class " n "\")" > file
+        }
+    }
+    print ")" > file
+}' || exit 1
+
+cat > "$ont/$name-odk.yaml" <<EOT
+id: $name
+title: "Synthetic ontology ($classes classes)"
+github_org: example
+repo: $name
+EOT
+
+cat > "$ont/Makefile" <<EOT
+# Synthetic ODK-like workflow, generated by $(basename $0).
+ONT = $name
+URIBASE = http://purl.obolibrary.org/obo
+ROBOT = robot --catalog catalog-v001.xml
+SRC = \$(ONT)-edit.owl
+DEPS = \$(wildcard imports/*.owl components/*.owl)
+
+all: \$(ONT).owl \$(ONT)-base.owl \$(ONT).obo
+test: reports/\$(ONT)-edit.owl-obo-report.tsv reason_test
+
+reason_test: \$(SRC) \$(DEPS)
+	\$(ROBOT) reason --input \$< --reasoner ELK --equivalent-classes-allowed asserted-only \\
+		--exclude-tautologies structural --output test.owl && rm test.owl
+
+reports/\$(ONT)-edit.owl-obo-report.tsv: \$(SRC) \$(DEPS)
+	\$(ROBOT) report -i \$< --fail-on None --print 5 -o \$@
+
+\$(ONT)-full.owl: \$(SRC) \$(DEPS)
+	\$(ROBOT) merge --input \$< \\
+		reason --reasoner ELK --equivalent-classes-allowed asserted-only --exclude-tautologies structural \\
+		relax reduce -r ELK \\
+		annotate --ontology-iri \$(URIBASE)/\$@ --output \$@
+
+\$(ONT).owl: \$(ONT)-full.owl
+	\$(ROBOT) annotate --input \$< --ontology-iri \$(URIBASE)/\$@ convert -o \$@
+
+\$(ONT)-base.owl: \$(SRC) \$(DEPS)
+	\$(ROBOT) remove --input \$< --select imports \\
+		merge \$(foreach c,\$(wildcard components/*.owl),-i \$(c)) \\
+		reason --reasoner ELK --equivalent-classes-allowed asserted-only --exclude-tautologies structural \\
+		relax reduce -r ELK \\
+		annotate --ontology-iri \$(URIBASE)/\$@ --output \$@
+
+\$(ONT).obo: \$(ONT).owl
+	\$(ROBOT) convert --input \$< --check false -f obo -o \$@
+
+.PHONY: all test reason_test
+EOT
@@ -0,0 +1,152 @@
+#!/bin/sh
+# Scaling benchmark for odkrun.
+#
+# Generates synthetic ODK-shaped repositories of several sizes (see
+# generate-repo.sh), runs a make target in each of them through odkrun
+# with each available backend, and records the elapsed time and peak
+# memory of every run as CSV lines:
+#
+#   backend,classes,axioms,run,status,seconds,peak_memory_kb
+#
+# which can be plotted directly to get scaling curves. On Linux, the
+# peak memory is taken from the resource usage recorded by odkrun
+# (--record-usage), which works the same for all backends; elsewhere,
+# it is taken from the --debug output, when the backend reports it.
+#
+# If a baseline file (the output of a previous run) is given, the
+# median times are compared with the baseline and any slowdown beyond
+# the threshold is reported as a regression (the script then exits
+# with status 2).
+#
+# Each run is done in a fresh copy of the generated repository, so that
+# all runs start from the same state.
+
+usage() {
+    cat <<EOT
+Usage: $0 [options] [-- ODKRUN_OPTIONS...]
+Options:
+    -b BACKENDS   Backends to test (default: all available among
+                  "docker singularity native").
+    -s SIZES      Numbers of classes (default: "1000 10000 100000").
+    -a AXIOMS     Axioms per class (default: 4).
+    -r RUNS       Number of runs for each backend and size (default: 3).
+    -t TARGET     Make target to run (default: all).
+    -o FILE       Write the results to FILE (default: standard output).
+    -c BASELINE   Compare the results with a previous output.
+    -T PERCENT    Regression threshold (default: 10).
+    -k DIR        Keep the generated repositories in DIR.
+Set ODKRUN to the odkrun binary to test (default: odkrun).
+EOT
+    exit $1
+}
+
+here=$(cd "$(dirname "$0")" && pwd)
+odkrun=${ODKRUN:-odkrun}
+backends=
+sizes="1000 10000 100000"
+axioms=4
+runs=3
+target=all
+output=
+baseline=
+threshold=10
+keep=
+while getopts b:s:a:r:t:o:c:T:k:h opt; do
+    case $opt in
+    b) backends=$OPTARG ;;
+    s) sizes=$OPTARG ;;
+    a) axioms=$OPTARG ;;
+    r) runs=$OPTARG ;;
+    t) target=$OPTARG ;;
+    o) output=$OPTARG ;;
+    c) baseline=$OPTARG ;;
+    T) threshold=$OPTARG ;;
+    k) keep=$OPTARG ;;
+    h) usage 0 ;;
+    *) usage 1 >&2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ "$1" = -- ] && shift
+
+if [ -z "$backends" ]; then
+    docker info > /dev/null 2>&1 && backends="$backends docker"
+    command -v singularity > /dev/null && backends="$backends singularity"
+    command -v robot > /dev/null && backends="$backends native"
+fi
+[ -n "$backends" ] || { echo "$0: no backend available" >&2; exit 1; }
+
+work=${keep:-${TMPDIR:-/tmp}/odkrun-bench.$$}
+mkdir -p "$work" || exit 1
+[ -n "$keep" ] || trap 'rm -rf "$work"' EXIT
+trap 'exit 1' INT TERM
+results=$work/results.csv
+usage=
+[ "$(uname -s)" = Linux ] && usage=$work/usage.csv
+
+echo "backend,classes,axioms,run,status,seconds,peak_memory_kb" > "$results"
+for size in $sizes; do
+    repo=$work/syn-$size-$axioms
+    [ -d "$repo" ] || sh "$here/generate-repo.sh" -c $size -a $axioms "$repo" || exit 1
+
+    for backend in $backends; do
+        case $backend in
+        docker) option= ;;
+        *) option=--$backend ;;
+        esac
+
+        run=1
+        while [ $run -le $runs ]; do
+            rm -rf "$work/run" && cp -a "$repo" "$work/run" || exit 1
+            [ -z "$usage" ] || rm -f "$usage"
+            # No terminal for the container: the output is not for a
+            # human, and there may not be one at all (e.g. on CI).
+            (cd "$work/run/src/ontology" && "$odkrun" $option --debug ${usage:+--record-usage "$usage"} "$@" make $target) \
+                < /dev/null > "$work/run.log" 2>&1
+            status=$?
+            { cat "$work/run.log"; [ -n "$usage" ] && [ -f "$usage" ] && sed 's/^/usage,/' "$usage"; } \
+                | awk -v backend=$backend -v size=$size -v axioms=$axioms -v run=$run -v status=$status '
+                { sub(/\r$/, "") }
+                /^Elapsed time: .* s$/ { seconds = $3 }
+                /^Peak memory: .* kb$/ { memory = $3 }
+                /^usage,[0-9]/ { split($0, f, ","); if ( f[3] + 0 > peak ) peak = f[3] + 0 }
+                END {
+                    if ( peak > 0 )
+                        memory = peak
+                    printf "%s,%d,%d,%d,%d,%s,%s\n", backend, size, axioms, run, status, seconds, memory
+                }' | tee -a "$results" >&2
+            [ $status -eq 0 ] || tail -n 5 "$work/run.log" >&2
+            run=$((run + 1))
+        done
+    done
+done
+rm -rf "$work/run"
+
+if [ -n "$output" ]; then
+    cp "$results" "$output"
+else
+    cat "$results"
+fi
+
+[ -n "$baseline" ] || exit 0
+
+# Median time of the successful runs for each backend and size.
+medians() {
+    awk -F, 'NR > 1 && $5 == 0 { print $1 "," $2 "," $3 "," $6 }' "$1" | sort -t, -k1,1 -k2,2n -k3,3n -k4,4n | awk -F, '
+        { key = $1 "," $2 "," $3; v[key, ++n[key]] = $4 }
+        END { for ( k in n ) { c = n[k]; m = c % 2 ? v[k, (c + 1) / 2] : (v[k, c / 2] + v[k, c / 2 + 1]) / 2; print k "," m } }'
+}
+
+medians "$baseline" > "$work/baseline.med"
+medians "$results" > "$work/results.med"
+awk -F, -v threshold=$threshold '
+    NR == FNR { base[$1 "," $2 "," $3] = $4; next }
+    ($1 "," $2 "," $3) in base {
+        old = base[$1 "," $2 "," $3]
+        change = old > 0 ? ($4 - old) * 100 / old : 0
+        verdict = change > threshold ? "REGRESSION" : change < -threshold ? "improvement" : "ok"
+        printf "%-12s %8d classes: %8.1f s -> %8.1f s (%+.1f%%) %s\n", $1, $2, old, $4, change, verdict
+        if ( verdict == "REGRESSION" )
+            regressions += 1
+    }
+    END { exit regressions > 0 ? 2 : 0 }' "$work/baseline.med" "$work/results.med" >&2
@@ -38,8 +38,12 @@
 #include <string.h>
 #include <errno.h>
 
-#if defined(ODK_RUNNER_LINUX)
-#include <unistd.h> /* for getuid/getgid */
+#if defined(ODK_RUNNER_WINDOWS)
+#include <io.h>
+#define isatty _isatty
+#define STDIN_FILENO 0
+#else
+#include <unistd.h> /* for getuid/getgid/isatty */
 #endif
 
 #include <memreg.h>
@@ -48,6 +52,33 @@
 #include "util.h"
 
 #define DOCKER_SSH_SOCKET "/run/host-services/ssh-auth.sock"
+#define DOCKER_HOME_DIR "/home/odkuser"
+
+/* Gets the IDs of the user the command should run as. */
+static void
+get_user_ids(unsigned *uid, unsigned *gid)
+{
+#if defined(ODK_RUNNER_LINUX)
+    *uid = getuid();
+    *gid = getgid();
+#else
+    *uid = 1000;
+    *gid = 1000;
+#endif
+}
+
+/*
+ * Checks whether the command should be started directly as the
+ * target user, rather than letting the entrypoint of the image create
+ * that user. Seeding still goes through the entrypoint, because it
+ * may need a full user account (with a passwd entry) to use SSH.
+ */
+static int
+use_direct_user(odk_run_config_t *cfg)
+{
+    return (cfg->flags & ODK_FLAG_DIRECTUSER)
+        && (cfg->flags & (ODK_FLAG_RUNASROOT | ODK_FLAG_SEEDMODE)) == 0;
+}
 
 static int
 prepare(odk_backend_t *backend, odk_run_config_t *cfg)
@@ -55,17 +86,16 @@ prepare(odk_backend_t *backend, odk_run_config_t *cfg)
     int ret = 0;
     char *ssh_socket;
 
-    if ( (cfg->flags & ODK_FLAG_RUNASROOT) == 0 ) {
-#if defined(ODK_RUNNER_LINUX)
-        char *user_id = mr_sprintf(NULL, "%u", getuid());
-        char *group_id = mr_sprintf(NULL, "%u", getgid());
-#else
-        char *user_id = "1000";
-        char *group_id = "1000";
-#endif
+    if ( use_direct_user(cfg) ) {
+        /* The entrypoint does nothing if ODK_USER_ID is not set; we
+         * only need to provide a writable home directory. */
+        odk_add_env_var(cfg, "HOME", DOCKER_HOME_DIR, 0);
+    } else if ( (cfg->flags & ODK_FLAG_RUNASROOT) == 0 ) {
+        unsigned uid, gid;
 
-        odk_add_env_var(cfg, "ODK_USER_ID", user_id, 0);
-        odk_add_env_var(cfg, "ODK_GROUP_ID", group_id, 0);
+        get_user_ids(&uid, &gid);
+        odk_add_env_var(cfg, "ODK_USER_ID", mr_sprintf(&cfg->mr, "%u", uid), 0);
+        odk_add_env_var(cfg, "ODK_GROUP_ID", mr_sprintf(&cfg->mr, "%u", gid), 0);
     }
 
     if ( (ssh_socket = getenv("SSH_AUTH_SOCK")) &&
@@ -83,52 +113,92 @@ prepare(odk_backend_t *backend, odk_run_config_t *cfg)
     return ret;
 }
 
-static int
-run(odk_backend_t *backend, odk_run_config_t *cfg, char **command)
+/*
+ * Assembles the Docker command line to run a command. A detached
+ * command line creates a container (which must then be started and
+ * removed explicitly) without a terminal, and without the prefixes for
+ * debug and seed modes.
+ */
+static char **
+make_command(odk_run_config_t *cfg, char **command, mem_registry_t *mr, int detached)
 {
-    int rc;
     size_t n, i = 0;
     char **argv, **cursor, *image_qualifier;
-    mem_registry_t mr = { 0 };
-
-    (void) backend;
 
     image_qualifier = strchr(cfg->image_name, '/') ? "" : "obolibrary/";
 
     /* Number of tokens in the command line */
     n = 9 + (cfg->n_bindings * 2) + (cfg->n_env_vars * 2);
-    if ( cfg->flags & ODK_FLAG_TIMEDEBUG )
+    if ( (cfg->flags & ODK_FLAG_TIMEDEBUG) && ! detached )
+        n += 3;
+    if ( (cfg->flags & (ODK_FLAG_SEEDMODE | ODK_FLAG_SEEDBATCH)) == ODK_FLAG_SEEDMODE && ! detached )
+        n += 2;
+    if ( cfg->priority == ODK_PRIORITY_BACKGROUND )
         n += 3;
-    if ( cfg->flags & ODK_FLAG_SEEDMODE )
+    else if ( cfg->priority == ODK_PRIORITY_HIGH )
         n += 2;
+    if ( use_direct_user(cfg) )
+        n += 4;
+    if ( cfg->network != ODK_NETWORK_DEFAULT )
+        n += 1;
+    if ( cfg->container_id_file )
+        n += 1;
     for ( cursor = &command[0]; *cursor; cursor++ )
         n += 1;
 
     /* Assembling the command line */
-    argv = mr_alloc(&mr, sizeof(char *) * n);
+    argv = mr_alloc(mr, sizeof(char *) * n);
     argv[i++] = "docker";
-    argv[i++] = "run";
-    argv[i++] = "--rm";
-    argv[i++] = "-ti";
+    if ( detached )
+        argv[i++] = "create";
+    else {
+        argv[i++] = "run";
+        argv[i++] = "--rm";
+        /* Only ask for a terminal if we have one to give (e.g. not when
+         * running on an executor through SSH, or from a script). */
+        argv[i++] = isatty(STDIN_FILENO) ? "-ti" : "-i";
+    }
     argv[i++] = "-w";
     argv[i++] = (char *)cfg->work_directory;
+    if ( cfg->priority == ODK_PRIORITY_BACKGROUND ) {
+        /* Default weights are 1024 for CPU and 500 for block I/O. */
+        argv[i++] = "--cpu-shares=256";
+        argv[i++] = "--blkio-weight=100";
+        argv[i++] = "--oom-score-adj=500";
+    } else if ( cfg->priority == ODK_PRIORITY_HIGH ) {
+        argv[i++] = "--cpu-shares=4096";
+        argv[i++] = "--blkio-weight=1000";
+    }
+    if ( use_direct_user(cfg) ) {
+        unsigned uid, gid;
+
+        get_user_ids(&uid, &gid);
+        argv[i++] = "--user";
+        argv[i++] = mr_sprintf(mr, "%u:%u", uid, gid);
+        argv[i++] = "--tmpfs";
+        argv[i++] = mr_sprintf(mr, DOCKER_HOME_DIR ":uid=%u,gid=%u,mode=0755", uid, gid);
+    }
+    if ( cfg->network != ODK_NETWORK_DEFAULT )
+        argv[i++] = mr_sprintf(mr, "--network=%s", odk_get_network_name(cfg->network));
+    if ( cfg->container_id_file )
+        argv[i++] = mr_sprintf(mr, "--cidfile=%s", cfg->container_id_file);
     for ( int j = 0; j < cfg->n_bindings; j++ ) {
         argv[i++] = "-v";
-        argv[i++] = mr_sprintf(&mr, "%s:%s", cfg->bindings[j].host_directory, cfg->bindings[j].container_directory);
+        argv[i++] = mr_sprintf(mr, "%s:%s", cfg->bindings[j].host_directory, cfg->bindings[j].container_directory);
     }
     for ( int j = 0; j < cfg->n_env_vars; j++ ) {
         if ( cfg->env_vars[j].value != NULL ) {
             argv[i++] = "-e";
-            argv[i++] = mr_sprintf(&mr, "%s=%s", cfg->env_vars[j].name, cfg->env_vars[j].value);
+            argv[i++] = mr_sprintf(mr, "%s=%s", cfg->env_vars[j].name, cfg->env_vars[j].value);
         }
     }
-    argv[i++] = mr_sprintf(&mr, "%s%s:%s", image_qualifier, cfg->image_name, cfg->image_tag);
-    if ( cfg->flags & ODK_FLAG_TIMEDEBUG ) {
+    argv[i++] = mr_sprintf(mr, "%s%s:%s", image_qualifier, cfg->image_name, cfg->image_tag);
+    if ( (cfg->flags & ODK_FLAG_TIMEDEBUG) && ! detached ) {
         argv[i++] = "/usr/bin/time";
         argv[i++] = "-f";
         argv[i++] = "### DEBUG STATS ###\nElapsed time: %E\nPeak memory: %M kb";
     }
-    if ( cfg->flags & ODK_FLAG_SEEDMODE ) {
+    if ( (cfg->flags & (ODK_FLAG_SEEDMODE | ODK_FLAG_SEEDBATCH)) == ODK_FLAG_SEEDMODE && ! detached ) {
         argv[i++] = "/tools/odk.py";
         argv[i++] = "seed";
     }
@@ -136,13 +206,52 @@ run(odk_backend_t *backend, odk_run_config_t *cfg, char **command)
         argv[i++] = *cursor;
     argv[i] = NULL;
 
+    return argv;
+}
+
+static int
+run(odk_backend_t *backend, odk_run_config_t *cfg, char **command)
+{
+    int rc;
+    char **argv;
+    mem_registry_t mr = { 0 };
+
+    argv = make_command(cfg, command, &mr, 0);
+
     /* Execute */
-    rc = spawn_process(argv);
+    rc = spawn_process(argv, &(backend->last_run));
     mr_free(&mr);
 
+    /* The resource usage figures are those of the Docker client, not
+     * those of the command within the container, so they are
+     * meaningless -- except for the elapsed time. */
+    backend->last_run.available &= ODK_STATS_WALLTIME;
+    /* Docker reports a container whose main process was killed by
+     * SIGKILL (as done by the OOM killer) with 128 + 9. */
+    backend->last_run.killed = rc == 137;
+
     return rc;
 }
 
+static char **
+pull_command(odk_backend_t *backend, odk_run_config_t *cfg)
+{
+    char **argv, *image_qualifier;
+
+    (void) backend;
+
+    image_qualifier = strchr(cfg->image_name, '/') ? "" : "obolibrary/";
+
+    argv = mr_alloc(&(cfg->mr), sizeof(char *) * 5);
+    argv[0] = "docker";
+    argv[1] = "pull";
+    argv[2] = "-q";
+    argv[3] = mr_sprintf(&(cfg->mr), "%s%s:%s", image_qualifier, cfg->image_name, cfg->image_tag);
+    argv[4] = NULL;
+
+    return argv;
+}
+
 static int
 close_backend(odk_backend_t *backend)
 {
@@ -152,13 +261,14 @@ close_backend(odk_backend_t *backend)
 }
 
 static int
-get_total_memory(odk_backend_info_t *info)
+probe(odk_backend_t *backend)
 {
     FILE *p;
     int ret = -1;
+    odk_backend_info_t *info = &(backend->info);
 
-    if ( (p = popen("docker info --format={{.MemTotal}}", "r")) != NULL ) {
-        if ( fscanf(p, "%lu", &(info->total_memory)) == 1 )
+    if ( (p = popen("docker info --format=\"{{.NCPU}} {{.MemTotal}} {{.Architecture}} {{.ServerVersion}}\"", "r")) != NULL ) {
+        if ( fscanf(p, "%u %lu %31s %63s", &(info->n_cpus), &(info->total_memory), info->arch, info->version) == 4 )
             ret = 0;
         else
             errno = ESRCH;
@@ -171,13 +281,31 @@ get_total_memory(odk_backend_info_t *info)
 int
 odk_backend_docker_init(odk_backend_t *backend)
 {
-    int ret;
-
+    backend->probe = probe;
+    backend->pull_command = pull_command;
     backend->prepare = prepare;
     backend->run = run;
+    backend->stats = odk_backend_default_stats;
     backend->close = close_backend;
 
-    ret = get_total_memory(&(backend->info));
+    backend->info.name = "docker";
 
-    return ret;
+    return probe(backend);
+}
+
+/**
+ * Gets the Docker command line to create (but not start) a container
+ * that would run the specified command with the specified
+ * configuration, without a terminal attached.
+ *
+ * @param cfg     The ODK configuration.
+ * @param command The command to run in the container.
+ *
+ * @return The command line, as a NULL-terminated array of arguments
+ *         allocated on the configuration's registry.
+ */
+char **
+odk_backend_docker_create_command(odk_run_config_t *cfg, char **command)
+{
+    return make_command(cfg, command, &(cfg->mr), 1);
 }
@@ -33,14 +33,17 @@
 
 #include "backend.h"
 
-#ifdef __cpluscplus
+#ifdef __cplusplus
 extern "C" {
 #endif
 
 int
 odk_backend_docker_init(odk_backend_t *);
 
-#ifdef __cpluscplus
+char **
+odk_backend_docker_create_command(odk_run_config_t *, char **);
+
+#ifdef __cplusplus
 }
 #endif
 
@@ -0,0 +1,580 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "backend-kubernetes.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+#include <signal.h>
+
+#if defined(HAVE_WINDOWS_H)
+#include <windows.h>
+#include <process.h>
+#define ODK_NULL_DEVICE "NUL"
+#else
+#include <unistd.h>
+#define ODK_NULL_DEVICE "/dev/null"
+#endif
+
+#include <xmem.h>
+#include <memreg.h>
+#include <sbuffer.h>
+
+#include "procutil.h"
+#include "util.h"
+
+/*
+ * Kubernetes backend.
+ *
+ * The command is run as a Kubernetes Job, submitted with kubectl
+ * (which must be configured to access the cluster). The following
+ * variables, if found in the configuration (e.g. in run.sh.conf),
+ * control how the Job is created:
+ *
+ * - ODK_K8S_NAMESPACE: the namespace in which to create the Job;
+ * - ODK_K8S_PVC: the name of a PersistentVolumeClaim that holds the
+ *   repository, to use instead of a hostPath volume for the working
+ *   directory (required unless the cluster runs on this machine);
+ * - ODK_K8S_PVC_SUBPATH: the path to the repository within that PVC;
+ * - ODK_K8S_START_TIMEOUT: how long to wait for the pod to start, in
+ *   seconds (default 600).
+ *
+ * The Job is deleted once its pod has terminated, or if odkrun is
+ * interrupted. It is also given a TTL, so that the cluster eventually
+ * removes it should odkrun be killed before it could do so.
+ */
+
+#define K8S_POLL_INTERVAL   1       /* In seconds */
+#define K8S_STATUS_TIMEOUT  60      /* In polls */
+#define K8S_START_TIMEOUT   600     /* In seconds */
+#define K8S_JOB_TTL         3600    /* In seconds */
+
+/* Set to the number of the signal that interrupted the run, if any. */
+static volatile sig_atomic_t interrupted = 0;
+
+#if !defined(HAVE_WINDOWS_H)
+/* The process streaming the logs, to stop when interrupted. */
+static volatile pid_t logs_pid = -1;
+#endif
+
+static void
+interrupt(int sig)
+{
+    interrupted = sig;
+#if !defined(HAVE_WINDOWS_H)
+    if ( logs_pid > 0 )
+        kill(logs_pid, SIGTERM);
+#endif
+}
+
+/* Gets a configuration variable. */
+static const char *
+get_cfg_var(odk_run_config_t *cfg, const char *name)
+{
+    for ( size_t i = 0; i < cfg->n_env_vars; i++ )
+        if ( strcmp(cfg->env_vars[i].name, name) == 0 )
+            return cfg->env_vars[i].value;
+
+    return NULL;
+}
+
+static void
+sleep_a_bit(void)
+{
+#if defined(HAVE_WINDOWS_H)
+    Sleep(K8S_POLL_INTERVAL * 1000);
+#else
+    sleep(K8S_POLL_INTERVAL);
+#endif
+}
+
+/*
+ * Checks that a name is a valid DNS-1123 label, as Kubernetes requires
+ * for namespaces and Job names. This also guarantees that the name can
+ * safely be inserted into a command line.
+ */
+static int
+is_valid_name(const char *name)
+{
+    size_t len = strlen(name);
+
+    if ( len == 0 || len > 63 || name[0] == '-' || name[len - 1] == '-' )
+        return 0;
+
+    for ( ; *name; name++ )
+        if ( ! ((*name >= 'a' && *name <= 'z') || (*name >= '0' && *name <= '9') || *name == '-') )
+            return 0;
+
+    return 1;
+}
+
+/* Prepares a kubectl command line, in the configured namespace. */
+static char *
+make_kubectl_command(odk_run_config_t *cfg, mem_registry_t *mr, const char *args)
+{
+    const char *ns = get_cfg_var(cfg, "ODK_K8S_NAMESPACE");
+
+    if ( ns )
+        return mr_sprintf(mr, "kubectl --namespace=%s %s", ns, args);
+    else
+        return mr_sprintf(mr, "kubectl %s", args);
+}
+
+/* Prepares a kubectl command, as an array of arguments, in the
+ * configured namespace. */
+static char **
+make_kubectl_argv(odk_run_config_t *cfg, mem_registry_t *mr, char **args)
+{
+    char **argv;
+    const char *ns;
+    size_t n = 3, i = 0;     /* kubectl --namespace NULL */
+
+    for ( char **cursor = args; *cursor; cursor++ )
+        n += 1;
+
+    argv = mr_alloc(mr, sizeof(char *) * n);
+    argv[i++] = "kubectl";
+    if ( (ns = get_cfg_var(cfg, "ODK_K8S_NAMESPACE")) )
+        argv[i++] = mr_sprintf(mr, "--namespace=%s", ns);
+    for ( char **cursor = args; *cursor; cursor++ )
+        argv[i++] = *cursor;
+    argv[i] = NULL;
+
+    return argv;
+}
+
+/* Appends a JSON string literal. */
+static void
+add_json_string(string_buffer_t *sb, const char *str)
+{
+    sb_addc(sb, '"');
+    for ( ; *str; str++ ) {
+        if ( *str == '"' || *str == '\\' )
+            sb_addf(sb, "\\%c", *str);
+        else if ( (unsigned char)*str < 0x20 )
+            sb_addf(sb, "\\u%04x", (unsigned char)*str);
+        else
+            sb_addc(sb, *str);
+    }
+    sb_addc(sb, '"');
+}
+
+/* Builds the description of the Job, in JSON. */
+static char *
+make_job_spec(odk_run_config_t *cfg, const char *name, char **command)
+{
+    string_buffer_t sb;
+    const char *pvc, *subpath, *image_qualifier;
+    unsigned long heap;
+    int first;
+
+    image_qualifier = strchr(cfg->image_name, '/') ? "" : "obolibrary/";
+    pvc = get_cfg_var(cfg, "ODK_K8S_PVC");
+    subpath = get_cfg_var(cfg, "ODK_K8S_PVC_SUBPATH");
+
+    sb_init(&sb, 4096);
+    sb_addf(&sb, "{\"apiVersion\":\"batch/v1\",\"kind\":\"Job\","
+            "\"metadata\":{\"name\":\"%s\",\"labels\":{\"app.kubernetes.io/managed-by\":\"odkrun\"}},"
+            "\"spec\":{\"backoffLimit\":0,\"ttlSecondsAfterFinished\":%d,\"template\":{\"spec\":{\"restartPolicy\":\"Never\","
+            "\"containers\":[{\"name\":\"odk\",\"image\":\"%s%s:%s\",\"workingDir\":",
+            name, K8S_JOB_TTL, image_qualifier, cfg->image_name, cfg->image_tag);
+    add_json_string(&sb, cfg->work_directory);
+
+    /* Arguments are passed to the entrypoint of the image, as with
+     * the Docker backend. */
+    sb_add(&sb, ",\"args\":[");
+    first = 1;
+    if ( cfg->flags & ODK_FLAG_TIMEDEBUG ) {
+        sb_add(&sb, "\"/usr/bin/time\",\"-f\",");
+        add_json_string(&sb, "### DEBUG STATS ###\nElapsed time: %E\nPeak memory: %M kb");
+        first = 0;
+    }
+    if ( (cfg->flags & (ODK_FLAG_SEEDMODE | ODK_FLAG_SEEDBATCH)) == ODK_FLAG_SEEDMODE ) {
+        sb_add(&sb, first ? "" : ",");
+        sb_add(&sb, "\"/tools/odk.py\",\"seed\"");
+        first = 0;
+    }
+    for ( char **cursor = command; *cursor; cursor++ ) {
+        sb_add(&sb, first ? "" : ",");
+        add_json_string(&sb, *cursor);
+        first = 0;
+    }
+
+    sb_add(&sb, "],\"env\":[");
+    first = 1;
+    for ( size_t i = 0; i < cfg->n_env_vars; i++ ) {
+        if ( cfg->env_vars[i].value == NULL || strncmp(cfg->env_vars[i].name, "ODK_K8S_", 8) == 0 )
+            continue;
+        sb_add(&sb, first ? "{\"name\":" : ",{\"name\":");
+        add_json_string(&sb, cfg->env_vars[i].name);
+        sb_add(&sb, ",\"value\":");
+        add_json_string(&sb, cfg->env_vars[i].value);
+        sb_addc(&sb, '}');
+        first = 0;
+    }
+
+    /* By default the heap is set to 90% of the memory reported by
+     * probe(), so request the same proportion (but at least 512 MB on
+     * top of the heap, for whatever else is running in the container). */
+    if ( (heap = (odk_get_java_max_heap(cfg) + 1024 * 1024 - 1) / (1024 * 1024)) > 0 ) {
+        unsigned long mem = heap * 10 / 9 > heap + 512 ? heap * 10 / 9 : heap + 512;
+
+        sb_addf(&sb, "],\"resources\":{\"requests\":{\"memory\":\"%luMi\"},"
+                "\"limits\":{\"memory\":\"%luMi\"}", mem, mem);
+        sb_add(&sb, "},\"volumeMounts\":[");
+    } else
+        sb_add(&sb, "],\"volumeMounts\":[");
+    for ( size_t i = 0; i < cfg->n_bindings; i++ ) {
+        sb_addf(&sb, "%s{\"name\":\"vol%zu\",\"mountPath\":", i > 0 ? "," : "", i);
+        add_json_string(&sb, cfg->bindings[i].container_directory);
+        if ( pvc && subpath && strcmp(cfg->bindings[i].container_directory, "/work") == 0 ) {
+            sb_add(&sb, ",\"subPath\":");
+            add_json_string(&sb, subpath);
+        }
+        sb_addc(&sb, '}');
+    }
+
+    sb_add(&sb, "]}],\"volumes\":[");
+    for ( size_t i = 0; i < cfg->n_bindings; i++ ) {
+        sb_addf(&sb, "%s{\"name\":\"vol%zu\",", i > 0 ? "," : "", i);
+        if ( pvc && strcmp(cfg->bindings[i].container_directory, "/work") == 0 ) {
+            sb_add(&sb, "\"persistentVolumeClaim\":{\"claimName\":");
+            add_json_string(&sb, pvc);
+        } else {
+            sb_add(&sb, "\"hostPath\":{\"path\":");
+            add_json_string(&sb, cfg->bindings[i].host_directory);
+        }
+        sb_add(&sb, "}}");
+    }
+    sb_add(&sb, "]}}}}\n");
+
+    return sb.buffer;
+}
+
+/* Submits the Job to the cluster. */
+static int
+create_job(odk_run_config_t *cfg, mem_registry_t *mr, const char *spec)
+{
+    FILE *p;
+    int ret = -1;
+
+    if ( (p = popen(make_kubectl_command(cfg, mr, "create -f - -o name > " ODK_NULL_DEVICE), "w")) ) {
+        if ( fputs(spec, p) != EOF )
+            ret = 0;
+        if ( pclose(p) != 0 )
+            ret = -1;
+    }
+
+    return ret;
+}
+
+/* Gets a status field of the pod created for the Job. Both the
+ * namespace and the name have been checked by is_valid_name(). */
+static char *
+get_pod_status(odk_run_config_t *cfg, mem_registry_t *mr, const char *name, const char *path)
+{
+    char *status;
+
+    status = read_line_from_pipe(make_kubectl_command(cfg, mr,
+                mr_sprintf(mr, "get pods --selector=job-name=%s --output=jsonpath=\"{.items[0].%s}\"", name, path)));
+
+    if ( status && ! *status ) {
+        free(status);
+        status = NULL;
+    }
+
+    return status;
+}
+
+/* Waits until the pod has started (or failed to start). */
+static int
+wait_for_pod(odk_run_config_t *cfg, mem_registry_t *mr, const char *name)
+{
+    char *phase, *reason;
+    const char *value;
+    unsigned long timeout = K8S_START_TIMEOUT;
+    unsigned missing = 0;
+    double deadline;
+
+    if ( (value = get_cfg_var(cfg, "ODK_K8S_START_TIMEOUT")) && sscanf(value, "%lu", &timeout) != 1 )
+        warnx("Ignoring invalid \"ODK_K8S_START_TIMEOUT\" value \"%s\"", value);
+    deadline = get_monotonic_time() + timeout;
+
+    while ( ! interrupted ) {
+        phase = get_pod_status(cfg, mr, name, "status.phase");
+        if ( phase && strcmp(phase, "Pending") != 0 ) {
+            free(phase);
+            return 0;
+        } else if ( ! phase && ++missing >= K8S_STATUS_TIMEOUT ) {
+            warnx("Cannot start Kubernetes pod: no pod created for Job %s", name);
+            return -1;
+        }
+        free(phase);
+
+        /* Errors that will not resolve themselves. */
+        reason = get_pod_status(cfg, mr, name, "status.containerStatuses[0].state.waiting.reason");
+        if ( reason && (strcmp(reason, "ErrImagePull") == 0 || strcmp(reason, "ImagePullBackOff") == 0
+                    || strcmp(reason, "InvalidImageName") == 0 || strcmp(reason, "CreateContainerConfigError") == 0) ) {
+            warnx("Cannot start Kubernetes pod: %s", reason);
+            free(reason);
+            return -1;
+        }
+        free(reason);
+
+        reason = get_pod_status(cfg, mr, name, "status.conditions[?(@.type=='PodScheduled')].reason");
+        if ( reason && strcmp(reason, "Unschedulable") == 0 ) {
+            warnx("Cannot start Kubernetes pod: no node can run it");
+            free(reason);
+            return -1;
+        }
+        free(reason);
+
+        if ( get_monotonic_time() >= deadline ) {
+            warnx("Cannot start Kubernetes pod: not started after %lu s", timeout);
+            return -1;
+        }
+
+        sleep_a_bit();
+    }
+
+    return -1;
+}
+
+/* Deletes the Job and its pod. */
+static int
+delete_job(odk_run_config_t *cfg, mem_registry_t *mr, char *name)
+{
+    char *args[] = { "delete", "job", name, "--cascade=background", "--wait=false", NULL };
+    odk_process_t proc;
+
+    if ( start_process(make_kubectl_argv(cfg, mr, args), PROCESS_QUIET, &proc) == -1 )
+        return -1;
+
+    return wait_process(&proc, NULL) == 0 ? 0 : -1;
+}
+
+/*
+ * Streams the output of the command until the pod has terminated, and
+ * gets the exit code of its container. The stream may end before the
+ * command does (e.g. if the connection to the API server drops during a
+ * long build), in which case we attach to it again.
+ */
+static int
+follow_pod(odk_run_config_t *cfg, mem_registry_t *mr, const char *name, int *killed)
+{
+    char *args[5], *phase, *code, *reason;
+    odk_process_t proc;
+    double stream_end = 0;
+    unsigned missing = 0;
+    int rc = -1;
+
+    args[0] = "logs";
+    args[1] = "--follow";
+    args[2] = mr_sprintf(mr, "job/%s", name);
+    args[3] = args[4] = NULL;
+
+    while ( ! interrupted ) {
+        /* When attaching again, only get what has been logged since the
+         * previous stream ended -- with a margin, so a few lines may be
+         * printed twice rather than lost. */
+        if ( stream_end > 0 )
+            args[3] = mr_sprintf(mr, "--since=%lus", (unsigned long)(get_monotonic_time() - stream_end) + 2);
+
+        if ( start_process(make_kubectl_argv(cfg, mr, args), 0, &proc) == 0 ) {
+#if !defined(HAVE_WINDOWS_H)
+            logs_pid = proc.pid;
+            if ( interrupted )
+                stop_process(&proc);
+#endif
+            wait_process(&proc, NULL);
+#if !defined(HAVE_WINDOWS_H)
+            logs_pid = -1;
+#endif
+        }
+        stream_end = get_monotonic_time();
+
+        if ( (phase = get_pod_status(cfg, mr, name, "status.phase")) ) {
+            missing = 0;
+            if ( strcmp(phase, "Succeeded") == 0 || strcmp(phase, "Failed") == 0 ) {
+                free(phase);
+                if ( (code = get_pod_status(cfg, mr, name, "status.containerStatuses[0].state.terminated.exitCode")) ) {
+                    rc = atoi(code);
+                    free(code);
+                } else
+                    warnx("Kubernetes pod for Job %s terminated without an exit code", name);
+                if ( (reason = get_pod_status(cfg, mr, name, "status.containerStatuses[0].state.terminated.reason")) ) {
+                    *killed = strcmp(reason, "OOMKilled") == 0;
+                    free(reason);
+                }
+                break;
+            }
+            free(phase);
+        } else if ( ++missing >= K8S_STATUS_TIMEOUT ) {
+            warnx("Cannot get the status of the Kubernetes pod for Job %s", name);
+            break;
+        }
+
+        sleep_a_bit();
+    }
+
+    return rc;
+}
+
+static int
+prepare(odk_backend_t *backend, odk_run_config_t *cfg)
+{
+    (void) backend;
+
+    /* We do not know the users of the cluster nodes, so we use the
+     * default ODK user unless told otherwise. */
+    if ( (cfg->flags & ODK_FLAG_RUNASROOT) == 0 ) {
+        odk_add_env_var(cfg, "ODK_USER_ID", "1000", ODK_NO_OVERWRITE);
+        odk_add_env_var(cfg, "ODK_GROUP_ID", "1000", ODK_NO_OVERWRITE);
+    }
+
+    return 0;
+}
+
+static int
+run(odk_backend_t *backend, odk_run_config_t *cfg, char **command)
+{
+    int rc = -1, killed = 0;
+    char *name, *spec;
+    const char *ns;
+    double start;
+    mem_registry_t mr = { 0 };
+    void (*old_sigint)(int), (*old_sigterm)(int);
+
+    if ( (ns = get_cfg_var(cfg, "ODK_K8S_NAMESPACE")) && ! is_valid_name(ns) ) {
+        warnx("Invalid Kubernetes namespace \"%s\"", ns);
+        return -1;
+    }
+
+    start = get_monotonic_time();
+    name = mr_sprintf(&mr, "odkrun-%lx-%llx", (long)getpid(), hash_fnv1a(FNV1A_INIT, &start, sizeof(start)) & 0xffffff);
+    spec = mr_register(&mr, make_job_spec(cfg, name, command), 0);
+
+    /* From now on, we must not terminate without deleting the Job. */
+    interrupted = 0;
+    old_sigint = signal(SIGINT, interrupt);
+    old_sigterm = signal(SIGTERM, interrupt);
+
+    if ( create_job(cfg, &mr, spec) == -1 )
+        warnx("Cannot create Kubernetes Job");
+    else {
+        if ( wait_for_pod(cfg, &mr, name) == 0 )
+            rc = follow_pod(cfg, &mr, name, &killed);
+
+        if ( interrupted ) {
+            warnx("Interrupted, deleting Kubernetes Job %s", name);
+            rc = 128 + interrupted;
+        }
+        if ( delete_job(cfg, &mr, name) == -1 )
+            warnx("Cannot delete Kubernetes Job %s", name);
+    }
+
+    signal(SIGINT, old_sigint);
+    signal(SIGTERM, old_sigterm);
+
+    backend->last_run.available = ODK_STATS_WALLTIME;
+    backend->last_run.wall_time = get_monotonic_time() - start;
+    backend->last_run.killed = killed;
+
+    mr_free(&mr);
+
+    return rc;
+}
+
+static int
+close_backend(odk_backend_t *backend)
+{
+    (void) backend;
+
+    return 0;
+}
+
+static int
+probe(odk_backend_t *backend)
+{
+    odk_backend_info_t *info = &(backend->info);
+    char *line, cpu[32], memory[32], *unit;
+    unsigned long amount;
+    int ret = -1;
+
+    /* Resources of the first schedulable node; listing the nodes may
+     * not be allowed, in which case we only check that the cluster is
+     * reachable at all. Only part of the allocatable memory is
+     * reported, since the pods that run on every node (DaemonSets)
+     * also take their share: a Job requesting it all could never be
+     * scheduled. */
+    line = read_line_from_pipe("kubectl get nodes --field-selector=spec.unschedulable=false "
+            "--output=jsonpath=\"{.items[0].status.allocatable.cpu} {.items[0].status.allocatable.memory} "
+            "{.items[0].status.nodeInfo.architecture} {.items[0].status.nodeInfo.kubeletVersion}\"");
+    if ( line && sscanf(line, "%31s %31s %31s %63s", cpu, memory, info->arch, info->version) == 4 ) {
+        /* Quantities are something like "8" or "7500m" for CPUs, and
+         * "16316412Ki" or "16Gi" for memory. */
+        amount = strtoul(cpu, &unit, 10);
+        info->n_cpus = *unit == 'm' ? amount / 1000 : amount;
+        amount = strtoul(memory, &unit, 10);
+        info->total_memory = amount * (*unit == 'K' ? 1024UL : *unit == 'M' ? 1024UL * 1024 : *unit == 'G' ? 1024UL * 1024 * 1024 : 1);
+        info->total_memory = info->total_memory / 4 * 3;
+        ret = 0;
+    } else {
+        free(line);
+        if ( (line = read_line_from_pipe("kubectl version > " ODK_NULL_DEVICE " 2>&1 && echo ok")) )
+            ret = 0;
+        else
+            errno = ESRCH;
+    }
+    free(line);
+
+    return ret;
+}
+
+int
+odk_backend_kubernetes_init(odk_backend_t *backend)
+{
+    backend->probe = probe;
+    backend->pull_command = NULL;
+    backend->prepare = prepare;
+    backend->run = run;
+    backend->stats = odk_backend_default_stats;
+    backend->close = close_backend;
+
+    backend->info.name = "kubernetes";
+
+    return probe(backend);
+}
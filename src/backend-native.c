@@ -34,38 +34,48 @@
 
 #include "backend-native.h"
 
+#include <errno.h>
+#include <stdio.h>
+
+#if !defined(ODK_RUNNER_WINDOWS)
+#include <sys/utsname.h>
+#endif
+
 #include <xmem.h>
 
 #include "procutil.h"
+#include "toolchain.h"
 #include "util.h"
 
 #if !defined(ODK_RUNNER_WINDOWS)
 
 static int
-run(odk_backend_t *backend, odk_run_config_t *cfg, char **command)
+prepare(odk_backend_t *backend, odk_run_config_t *cfg)
 {
-    int rc;
-
     (void) backend;
 
-    /* Setting up the environment */
-    for ( int j = 0; j < cfg->n_env_vars; j++ ) {
-        if ( cfg->env_vars[j].value != NULL )
-            setenv(cfg->env_vars[j].name, cfg->env_vars[j].value, 1);
-        else
-            unsetenv(cfg->env_vars[j].name);
-    }
+    /* Use the toolchain extracted from the image, if any; otherwise
+     * we assume the ODK tools are available in the PATH. */
+    odk_toolchain_setup(cfg);
+
+    return 0;
+}
+
+static int
+run(odk_backend_t *backend, odk_run_config_t *cfg, char **command)
+{
+    int rc;
 
     if ( cfg->flags & ODK_FLAG_TIMEDEBUG || cfg->flags & ODK_FLAG_SEEDMODE ) {
         /* In debug mode, the provided command line must be prefixed
          * with the time command; in seed mode, it must be prefixed with
          * the call to "odk.py seed". */
         char **argv, **cursor;
-        size_t n = 0, i = 0;
+        size_t n = 1, i = 0;    /* Terminating NULL */
 
         if ( cfg->flags & ODK_FLAG_TIMEDEBUG )
             n += 3;
-        if ( cfg->flags & ODK_FLAG_SEEDMODE )
+        if ( (cfg->flags & (ODK_FLAG_SEEDMODE | ODK_FLAG_SEEDBATCH)) == ODK_FLAG_SEEDMODE )
             n += 2;
 
         for ( cursor = &command[0]; *cursor; cursor++ )
@@ -77,7 +87,7 @@ run(odk_backend_t *backend, odk_run_config_t *cfg, char **command)
             argv[i++] = "-f";
             argv[i++] = "### DEBUG STATS ###\nElapsed time: %E\nPeak memory: %M kb";
         }
-        if ( cfg->flags & ODK_FLAG_SEEDMODE ) {
+        if ( (cfg->flags & (ODK_FLAG_SEEDMODE | ODK_FLAG_SEEDBATCH)) == ODK_FLAG_SEEDMODE ) {
             argv[i++] = "odk.py";   /* We assume the odk.py script is in PATH */
             argv[i++] = "seed";
         }
@@ -85,11 +95,11 @@ run(odk_backend_t *backend, odk_run_config_t *cfg, char **command)
             argv[i++] = *cursor;
         argv[i] = NULL;
 
-        rc = spawn_process(argv);
+        rc = spawn_process_env(argv, cfg->env_vars, cfg->n_env_vars, cfg->priority, &(backend->last_run));
         free(argv);
     } else
         /* We can use the provided command line as it is. */
-        rc = spawn_process(command);
+        rc = spawn_process_env(command, cfg->env_vars, cfg->n_env_vars, cfg->priority, &(backend->last_run));
 
     return rc;
 }
@@ -102,6 +112,24 @@ close(odk_backend_t *backend)
     return 0;
 }
 
+static int
+probe(odk_backend_t *backend)
+{
+    odk_backend_info_t *info = &(backend->info);
+    struct utsname un;
+
+    info->total_memory = get_memory_limit();
+    info->n_cpus = get_cpu_count();
+    get_machine_arch(info->arch, sizeof(info->arch));
+
+    /* There is no container engine, report the host system instead. */
+    if ( uname(&un) == -1 || (size_t) snprintf(info->version, sizeof(info->version), "%s %s",
+                                                un.sysname, un.release) >= sizeof(info->version) )
+        info->version[0] = '\0';
+
+    return 0;
+}
+
 #endif /* !ODK_RUNNER_WINDOWS */
 
 int
@@ -111,12 +139,15 @@ odk_backend_native_init(odk_backend_t *backend)
     errno = ENOSYS;
     return -1;
 #else
-    backend->prepare = NULL;
+    backend->probe = probe;
+    backend->pull_command = NULL;
+    backend->prepare = prepare;
     backend->run = run;
+    backend->stats = odk_backend_default_stats;
     backend->close = close;
 
-    backend->info.total_memory = get_physical_memory();
+    backend->info.name = "native";
 
-    return 0;
+    return probe(backend);
 #endif
 }
@@ -34,6 +34,7 @@
 
 #include "backend-singularity.h"
 
+#include <stdio.h>
 #include <string.h>
 
 #if defined(ODK_RUNNER_LINUX)
@@ -56,8 +57,8 @@ prepare(odk_backend_t *backend, odk_run_config_t *cfg)
 
     if ( (cfg->flags & ODK_FLAG_RUNASROOT) == 0 ) {
 #if defined(ODK_RUNNER_LINUX)
-        char *user_id = mr_sprintf(NULL, "%u", getuid());
-        char *group_id = mr_sprintf(NULL, "%u", getgid());
+        char *user_id = mr_sprintf(&cfg->mr, "%u", getuid());
+        char *group_id = mr_sprintf(&cfg->mr, "%u", getgid());
 #else
         char *user_id = "1000";
         char *group_id = "1000";
@@ -84,8 +85,6 @@ run(odk_backend_t *backend, odk_run_config_t *cfg, char **command)
     mem_registry_t mr = { 0 };
     string_buffer_t sb;
 
-    (void) backend;
-
     image_qualifier = strchr(cfg->image_name, '/') ? "" : "obolibrary/";
 
     /* Number of tokens in the command line */
@@ -96,8 +95,10 @@ run(odk_backend_t *backend, odk_run_config_t *cfg, char **command)
         n += 2;
     if ( cfg->flags & ODK_FLAG_TIMEDEBUG )
         n += 3;
-    if ( cfg->flags & ODK_FLAG_SEEDMODE )
+    if ( (cfg->flags & (ODK_FLAG_SEEDMODE | ODK_FLAG_SEEDBATCH)) == ODK_FLAG_SEEDMODE )
         n += 2;
+    if ( cfg->network == ODK_NETWORK_NONE || cfg->network == ODK_NETWORK_BRIDGE )
+        n += 3;
     for ( cursor = &command[0]; *cursor; cursor++ )
         n += 1;
 
@@ -129,6 +130,12 @@ run(odk_backend_t *backend, odk_run_config_t *cfg, char **command)
         argv[i++] = mr_register(&mr, sb_get_copy(&sb), 0);
         sb_empty(&sb);
     }
+    if ( cfg->network == ODK_NETWORK_NONE || cfg->network == ODK_NETWORK_BRIDGE ) {
+        /* Singularity shares the host network unless asked otherwise. */
+        argv[i++] = "--net";
+        argv[i++] = "--network";
+        argv[i++] = (char *)odk_get_network_name(cfg->network);
+    }
     argv[i++] = "-W";
     argv[i++] = (char *)cfg->work_directory;
     argv[i++] = mr_sprintf(&mr, "docker://%s%s:%s", image_qualifier, cfg->image_name, cfg->image_tag);
@@ -137,7 +144,7 @@ run(odk_backend_t *backend, odk_run_config_t *cfg, char **command)
         argv[i++] = "-f";
         argv[i++] = "### DEBUG STATS ###\nElapsed time: %E\nPeak memory: %M kb";
     }
-    if ( cfg->flags & ODK_FLAG_SEEDMODE ) {
+    if ( (cfg->flags & (ODK_FLAG_SEEDMODE | ODK_FLAG_SEEDBATCH)) == ODK_FLAG_SEEDMODE ) {
         argv[i++] = "/tools/odk.py";
         argv[i++] = "seed";
     }
@@ -146,13 +153,39 @@ run(odk_backend_t *backend, odk_run_config_t *cfg, char **command)
     argv[i] = NULL;
 
     /* Execute */
-    rc = spawn_process(argv);
+    /* Processes in the container are descendants of the process we
+     * spawn, so they will inherit its scheduling priority. */
+    rc = spawn_process_env(argv, NULL, 0, cfg->priority, &(backend->last_run));
     mr_free(&mr);
     free(sb.buffer);
 
     return rc;
 }
 
+static char **
+pull_command(odk_backend_t *backend, odk_run_config_t *cfg)
+{
+    char **argv, *image_qualifier;
+
+    (void) backend;
+
+    image_qualifier = strchr(cfg->image_name, '/') ? "" : "obolibrary/";
+
+    /* There is no way to ask Singularity to only convert a Docker
+     * image to SIF, but executing a no-op command in the image does
+     * just that, and leaves the SIF file in Singularity's cache for
+     * the actual run to use. */
+    argv = mr_alloc(&(cfg->mr), sizeof(char *) * 6);
+    argv[0] = "singularity";
+    argv[1] = "exec";
+    argv[2] = "--cleanenv";
+    argv[3] = mr_sprintf(&(cfg->mr), "docker://%s%s:%s", image_qualifier, cfg->image_name, cfg->image_tag);
+    argv[4] = "true";
+    argv[5] = NULL;
+
+    return argv;
+}
+
 static
 int close_backend(odk_backend_t *backend)
 {
@@ -161,14 +194,45 @@ int close_backend(odk_backend_t *backend)
     return 0;
 }
 
+static int
+probe(odk_backend_t *backend)
+{
+    odk_backend_info_t *info = &(backend->info);
+    char *version;
+
+    /* Singularity containers are ordinary processes on the host, so
+     * they have access to the same resources as we do. */
+    info->total_memory = get_memory_limit();
+    info->n_cpus = get_cpu_count();
+    get_machine_arch(info->arch, sizeof(info->arch));
+
+    /* Something like "singularity-ce version 4.1.0" or
+     * "apptainer version 1.3.0". */
+    if ( (version = read_line_from_pipe("singularity --version")) ) {
+        char *p;
+
+        if ( (p = strrchr(version, ' ')) )
+            p += 1;
+        else
+            p = version;
+        snprintf(info->version, sizeof(info->version), "%s", p);
+        free(version);
+    }
+
+    return 0;
+}
+
 int
 odk_backend_singularity_init(odk_backend_t *backend)
 {
+    backend->probe = probe;
+    backend->pull_command = pull_command;
     backend->prepare = prepare;
     backend->run = run;
+    backend->stats = odk_backend_default_stats;
     backend->close = close_backend;
 
-    backend->info.total_memory = get_physical_memory();
+    backend->info.name = "singularity";
 
-    return 0;
+    return probe(backend);
 }
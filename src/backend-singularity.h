@@ -33,14 +33,14 @@
 
 #include "backend.h"
 
-#ifdef __cpluscplus
+#ifdef __cplusplus
 extern "C" {
 #endif
 
 int
 odk_backend_singularity_init(odk_backend_t *);
 
-#ifdef __cpluscplus
+#ifdef __cplusplus
 }
 #endif
 
@@ -33,17 +33,64 @@
 
 #include "runner.h"
 
-/* Holds backend-specific data. */
+/* Holds backend-specific data, as reported by the probe function. */
 typedef struct odk_backend_info {
-    unsigned long total_memory;
+    const char     *name;
+    unsigned long   total_memory;
+    unsigned        n_cpus;
+    char            arch[32];
+    char            version[64];
 } odk_backend_info_t;
 
+/* Resource usage of a command executed by a backend. Not all backends
+ * can report all figures; the 'available' field indicates which ones
+ * are meaningful. */
+typedef struct odk_run_stats {
+    unsigned    available;
+    double      wall_time;      /* In seconds */
+    double      user_time;      /* In seconds */
+    double      system_time;    /* In seconds */
+    long        peak_memory;    /* In kilobytes */
+    long        read_ops;       /* Number of block input operations */
+    long        write_ops;      /* Number of block output operations */
+    int         killed;         /* Killed by the system, e.g. out of memory */
+} odk_run_stats_t;
+
+#define ODK_STATS_WALLTIME  0x01
+#define ODK_STATS_CPUTIME   0x02
+#define ODK_STATS_MEMORY    0x04
+#define ODK_STATS_IO        0x08
+
 typedef struct odk_backend odk_backend_t;
 
 /* Represents a ODK backend, with (1) function pointers to the actual
  * implementations and (2) backend-specific data. */
 struct odk_backend {
     odk_backend_info_t info;
+    odk_run_stats_t    last_run;
+
+    /**
+     * Queries the resources available to the backend, and stores
+     * them into the 'info' field of the backend.
+     *
+     * @param backend The backend in use.
+     *
+     * @return 0 if successful, or -1 if an error occured.
+     */
+    int   (*probe)(odk_backend_t *backend);
+
+    /**
+     * Gets the command to fetch the configured image, so that it can
+     * be fetched ahead of the actual run.
+     *
+     * @param backend The backend in use.
+     * @param cfg     The ODK configuration.
+     *
+     * @return The command, as a NULL-terminated array of arguments
+     *         allocated on the configuration's registry, or NULL if
+     *         there is nothing to fetch.
+     */
+    char **(*pull_command)(odk_backend_t *backend, odk_run_config_t *cfg);
 
     /**
      * Updates the runner configuration with backend-specific infos.
@@ -68,6 +115,17 @@ struct odk_backend {
     int   (*run)(odk_backend_t *backend, odk_run_config_t *cfg,
                  char **command);
 
+    /**
+     * Gets resource usage figures for the last command executed.
+     *
+     * @param backend The backend in use.
+     * @param stats   The structure to fill with the figures.
+     *
+     * @return 0 if successful, or -1 if no command has been executed
+     *         yet.
+     */
+    int   (*stats)(odk_backend_t *backend, odk_run_stats_t *stats);
+
     /*
      * Frees resources associated with the backend.
      *
@@ -87,5 +145,25 @@ struct odk_backend {
  */
 typedef int (*odk_backend_init)(odk_backend_t *backend);
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Gets resource usage figures for the last command executed, as
+ * recorded in the 'last_run' field of the backend. This is suitable
+ * as the 'stats' function of any backend that fills that field.
+ *
+ * @param backend The backend in use.
+ * @param stats   The structure to fill with the figures.
+ *
+ * @return 0 if successful, or -1 if no command has been executed yet.
+ */
+int
+odk_backend_default_stats(odk_backend_t *backend, odk_run_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* !ICP20240622_BACKEND_H */
@@ -0,0 +1,736 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+
+#if !defined(ODK_RUNNER_WINDOWS)
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include <xmem.h>
+#include <memreg.h>
+
+#include "checkpoint.h"
+#include "oaklib.h"
+#include "procutil.h"
+#include "runlock.h"
+#include "sparql.h"
+#include "toolchain.h"
+#include "util.h"
+
+/*
+ * Cache accounting.
+ *
+ * Several features of the runner leave data behind to make later runs
+ * faster. Each such location is described by a odk_cache_t structure,
+ * which tells what the unit of removal is when the cache has to be
+ * trimmed: either the top-level entries of the cache directory (an OAK
+ * database, a native toolchain, a SPARQL database), or whole images
+ * (for Singularity's cache, whose internal structure we must not
+ * break), or only the entries that are known to be stale.
+ *
+ * Trimming removes the least recently used units until the cache fits
+ * within its budget, which can be set with a ODK_CACHE_BUDGET_<NAME>
+ * variable (in run.sh.conf or in the environment). The caches within a
+ * repository are only trimmed if no command is running there; the
+ * caches shared between repositories are only trimmed if no command is
+ * using them, as each command holds a shared lock on those it uses.
+ */
+
+#if !defined(ODK_RUNNER_WINDOWS)
+
+#define CACHE_ENTRIES   0   /* Top-level entries are removed */
+#define CACHE_IMAGES    1   /* Whole images are removed */
+#define CACHE_STALE     2   /* Only stale entries are removed */
+
+#define GB  (1024ULL * 1024 * 1024)
+
+/* A removable unit of a cache. */
+typedef struct cache_item {
+    char               *path;
+    char               *link;       /* Symlink to remove along with it */
+    unsigned long long  size;
+    time_t              last_use;
+} cache_item_t;
+
+typedef struct odk_cache {
+    const char         *name;
+    const char         *budget_var;
+    unsigned long long  default_budget;
+    int                 mode;
+    char               *path;
+    cache_item_t       *items;
+    size_t              n_items;
+    size_t              max_items;
+    unsigned long long  size;
+    time_t              last_use;
+    int                 hit_rate;   /* In percent, or -1 if unknown */
+    int                 in_repo;
+} odk_cache_t;
+
+/* Registers a cache, if its directory exists. */
+static void
+add_cache(odk_cache_t *caches, size_t *n, const char *name, char *path, int mode,
+          const char *budget_var, unsigned long long default_budget)
+{
+    struct stat st;
+
+    if ( ! path || stat(path, &st) == -1 || ! S_ISDIR(st.st_mode) )
+        return;
+
+    memset(&caches[*n], 0, sizeof(odk_cache_t));
+    caches[*n].name = name;
+    caches[*n].path = path;
+    caches[*n].mode = mode;
+    caches[*n].budget_var = budget_var;
+    caches[*n].default_budget = default_budget;
+    caches[*n].hit_rate = -1;
+    *n += 1;
+}
+
+/* Gets the size and last use time of a file or a directory tree. */
+static void
+get_usage(const char *path, unsigned long long *size, time_t *last_use)
+{
+    struct stat st;
+    DIR *dir;
+    struct dirent *entry;
+
+    if ( lstat(path, &st) == -1 )
+        return;
+
+    *size += (unsigned long long)st.st_blocks * 512;
+    if ( st.st_mtime > *last_use )
+        *last_use = st.st_mtime;
+    if ( st.st_atime > *last_use )
+        *last_use = st.st_atime;
+
+    if ( S_ISDIR(st.st_mode) && (dir = opendir(path)) ) {
+        while ( (entry = readdir(dir)) ) {
+            char *child;
+
+            if ( strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 )
+                continue;
+
+            xasprintf(&child, "%s/%s", path, entry->d_name);
+            get_usage(child, size, last_use);
+            free(child);
+        }
+        closedir(dir);
+    }
+}
+
+/* Removes a file or a directory tree. */
+static int
+remove_tree(const char *path)
+{
+    struct stat st;
+    DIR *dir;
+    struct dirent *entry;
+
+    if ( lstat(path, &st) == -1 )
+        return errno == ENOENT ? 0 : -1;
+
+    if ( S_ISDIR(st.st_mode) && (dir = opendir(path)) ) {
+        while ( (entry = readdir(dir)) ) {
+            char *child;
+
+            if ( strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 )
+                continue;
+
+            xasprintf(&child, "%s/%s", path, entry->d_name);
+            remove_tree(child);
+            free(child);
+        }
+        closedir(dir);
+        return rmdir(path);
+    }
+
+    return unlink(path);
+}
+
+/* Adds a removable unit to a cache. */
+static void
+add_item(odk_cache_t *cache, char *path, char *link)
+{
+    cache_item_t *item;
+
+    if ( cache->n_items >= cache->max_items ) {
+        cache->max_items = cache->max_items ? cache->max_items * 2 : 16;
+        cache->items = xrealloc(cache->items, sizeof(cache_item_t) * cache->max_items);
+    }
+
+    item = &(cache->items[cache->n_items++]);
+    item->path = path;
+    item->link = link;
+    item->size = 0;
+    item->last_use = 0;
+    get_usage(path, &(item->size), &(item->last_use));
+}
+
+/*
+ * Collects the images of a Singularity/Apptainer cache. Each
+ * subdirectory (oci-tmp, library, oras, etc.) contains one entry per
+ * image, which can be removed independently; the exception is the
+ * "blob" subdirectory, a OCI layout whose blobs are shared and indexed,
+ * which can only be removed as a whole.
+ */
+static void
+scan_images(odk_cache_t *cache)
+{
+    DIR *dir, *subdir;
+    struct dirent *entry, *image;
+    struct stat st;
+
+    if ( ! (dir = opendir(cache->path)) )
+        return;
+
+    while ( (entry = readdir(dir)) ) {
+        char *path, *child;
+
+        if ( strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 )
+            continue;
+
+        xasprintf(&path, "%s/%s", cache->path, entry->d_name);
+        if ( lstat(path, &st) == -1 || ! S_ISDIR(st.st_mode) ) {
+            free(path);
+            continue;
+        }
+
+        if ( strcmp(entry->d_name, "blob") == 0 || ! (subdir = opendir(path)) ) {
+            add_item(cache, path, NULL);
+            continue;
+        }
+
+        while ( (image = readdir(subdir)) ) {
+            if ( strcmp(image->d_name, ".") == 0 || strcmp(image->d_name, "..") == 0 )
+                continue;
+
+            xasprintf(&child, "%s/%s", path, image->d_name);
+            add_item(cache, child, NULL);
+        }
+        closedir(subdir);
+        free(path);
+    }
+    closedir(dir);
+}
+
+/* Checks whether a top-level entry is the target of a symlink in the
+ * same directory (SPARQL databases are accessed through such links;
+ * the link and its target must be removed together). */
+static int
+is_link_target(const char *directory, const char *name)
+{
+    DIR *dir;
+    struct dirent *entry;
+    char target[256];
+    int found = 0;
+
+    if ( ! (dir = opendir(directory)) )
+        return 0;
+
+    while ( ! found && (entry = readdir(dir)) ) {
+        char *path;
+        ssize_t len;
+
+        xasprintf(&path, "%s/%s", directory, entry->d_name);
+        if ( (len = readlink(path, target, sizeof(target) - 1)) > 0 ) {
+            target[len] = '\0';
+            found = strcmp(target, name) == 0;
+        }
+        free(path);
+    }
+    closedir(dir);
+
+    return found;
+}
+
+/* Checks whether a shims directory belongs to a process that no
+ * longer exists. */
+static int
+is_stale_shims(const char *name)
+{
+    char *end;
+    long pid;
+
+    if ( strncmp(name, "shims-", 6) != 0 )
+        return 0;
+
+    pid = strtol(name + 6, &end, 10);
+    if ( *end != '\0' || pid <= 0 )
+        return 0;
+
+    return kill((pid_t)pid, 0) == -1 && errno == ESRCH;
+}
+
+/* Collects the removable units of a cache. */
+static void
+scan_cache(odk_cache_t *cache)
+{
+    DIR *dir;
+    struct dirent *entry;
+
+    /* For a directory where only stale entries are considered, the
+     * size of the cache is the size of those entries. */
+    if ( cache->mode != CACHE_STALE )
+        get_usage(cache->path, &(cache->size), &(cache->last_use));
+
+    if ( cache->mode == CACHE_IMAGES ) {
+        scan_images(cache);
+        return;
+    }
+
+    if ( ! (dir = opendir(cache->path)) )
+        return;
+
+    while ( (entry = readdir(dir)) ) {
+        char *path, *target = NULL, buffer[256];
+        ssize_t len;
+
+        if ( strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0
+                || strcmp(entry->d_name, ODK_RUNNER_CACHE_LOCK) == 0 )
+            continue;
+
+        if ( cache->mode == CACHE_STALE ) {
+            if ( is_stale_shims(entry->d_name) ) {
+                xasprintf(&path, "%s/%s", cache->path, entry->d_name);
+                add_item(cache, path, NULL);
+                cache->size += cache->items[cache->n_items - 1].size;
+                if ( cache->items[cache->n_items - 1].last_use > cache->last_use )
+                    cache->last_use = cache->items[cache->n_items - 1].last_use;
+            }
+            continue;
+        }
+
+        /* Keep the usage counters of the SPARQL store. */
+        if ( strcmp(entry->d_name, "stats") == 0 )
+            continue;
+        if ( is_link_target(cache->path, entry->d_name) )
+            continue;
+
+        xasprintf(&path, "%s/%s", cache->path, entry->d_name);
+        if ( (len = readlink(path, buffer, sizeof(buffer) - 1)) > 0 ) {
+            buffer[len] = '\0';
+            target = path;
+            xasprintf(&path, "%s/%s", cache->path, buffer);
+        }
+        add_item(cache, path, target);
+    }
+    closedir(dir);
+}
+
+/* Lists the caches known to the runner. */
+static size_t
+find_caches(odk_run_config_t *cfg, odk_cache_t *caches)
+{
+    size_t n = 0;
+    char buffer[2048], *dir, *home;
+    const char *oak = cfg->oak_cache_directory;
+
+    if ( oak && strcasecmp(oak, ODK_SHARING_OAKLIB_USER_CACHE) != 0
+             && strcasecmp(oak, ODK_SHARING_OAKLIB_REPO_CACHE) != 0 )
+        dir = (char *)oak;
+    else {
+        int len = get_oaklib_cache_directory(buffer, sizeof(buffer));
+        dir = len > 0 && (size_t)len < sizeof(buffer) ? buffer : NULL;
+    }
+    add_cache(caches, &n, "oak", dir ? mr_strdup(&cfg->mr, dir) : NULL, CACHE_ENTRIES,
+              "ODK_CACHE_BUDGET_OAK", 5 * GB);
+
+    if ( cfg->flags & ODK_FLAG_INODKREPO ) {
+        size_t first = n;
+
+        add_cache(caches, &n, "oak-repo", "tmp/oaklib", CACHE_ENTRIES,
+                  "ODK_CACHE_BUDGET_OAK_REPO", 2 * GB);
+        add_cache(caches, &n, "sparql", ODK_SPARQL_STORE_DIR, CACHE_ENTRIES,
+                  "ODK_CACHE_BUDGET_SPARQL", 2 * GB);
+        add_cache(caches, &n, "shims", ODK_RUNNER_STATE_DIR, CACHE_STALE, NULL, 0);
+        add_cache(caches, &n, "checkpoint", ODK_CHECKPOINT_DIR, CACHE_ENTRIES,
+                  "ODK_CACHE_BUDGET_CHECKPOINT", 10 * GB);
+
+        /* Stale shims are not used by anyone, by definition. */
+        for ( size_t i = first; i < n; i++ )
+            caches[i].in_repo = caches[i].mode != CACHE_STALE;
+    }
+
+    add_cache(caches, &n, "native", odk_toolchain_get_cache_directory(cfg), CACHE_ENTRIES,
+              "ODK_CACHE_BUDGET_NATIVE", 10 * GB);
+
+    if ( (dir = getenv("APPTAINER_CACHEDIR")) || (dir = getenv("SINGULARITY_CACHEDIR")) )
+        add_cache(caches, &n, "singularity", dir, CACHE_IMAGES,
+                  "ODK_CACHE_BUDGET_SINGULARITY", 20 * GB);
+    else if ( (home = getenv("HOME")) ) {
+        add_cache(caches, &n, "apptainer", mr_sprintf(&cfg->mr, "%s/.apptainer/cache", home), CACHE_IMAGES,
+                  "ODK_CACHE_BUDGET_SINGULARITY", 20 * GB);
+        add_cache(caches, &n, "singularity", mr_sprintf(&cfg->mr, "%s/.singularity/cache", home), CACHE_IMAGES,
+                  "ODK_CACHE_BUDGET_SINGULARITY", 20 * GB);
+    }
+
+    return n;
+}
+
+/* Parses a size with an optional K, M, G or T suffix. */
+static int
+parse_size(const char *value, unsigned long long *size)
+{
+    char *end;
+    unsigned long long amount;
+
+    errno = 0;
+    amount = strtoull(value, &end, 10);
+    if ( errno != 0 || end == value )
+        return -1;
+
+    switch ( *end ) {
+    case 't': case 'T': amount *= 1024;     /* fall through */
+    case 'g': case 'G': amount *= 1024;     /* fall through */
+    case 'm': case 'M': amount *= 1024;     /* fall through */
+    case 'k': case 'K': amount *= 1024; end++; break;
+    }
+
+    if ( *end != '\0' && strcmp(end, "B") != 0 && strcmp(end, "b") != 0 )
+        return -1;
+
+    *size = amount;
+    return 0;
+}
+
+/* Gets the budget of a cache, from the configuration if set. */
+static unsigned long long
+get_budget(odk_run_config_t *cfg, odk_cache_t *cache)
+{
+    unsigned long long budget = cache->default_budget;
+
+    if ( ! cache->budget_var )
+        return 0;
+
+    for ( size_t i = 0; i < cfg->n_env_vars; i++ ) {
+        if ( strcmp(cfg->env_vars[i].name, cache->budget_var) == 0 && cfg->env_vars[i].value ) {
+            if ( parse_size(cfg->env_vars[i].value, &budget) == -1 ) {
+                fprintf(stderr, "odkrun: Ignoring invalid \"%s\" value \"%s\"\n",
+                        cache->budget_var, cfg->env_vars[i].value);
+                budget = cache->default_budget;
+            }
+        }
+    }
+
+    return budget;
+}
+
+/* Formats a size in a human-readable way. */
+static const char *
+format_size(char *buffer, size_t len, unsigned long long size)
+{
+    const char *units[] = { "B", "KB", "MB", "GB", "TB" };
+    double value = size;
+    unsigned i = 0;
+
+    while ( value >= 1024 && i < 4 ) {
+        value /= 1024;
+        i += 1;
+    }
+    snprintf(buffer, len, i == 0 ? "%.0f %s" : "%.1f %s", value, units[i]);
+
+    return buffer;
+}
+
+/* Formats a time stamp, or a dash if unknown. */
+static const char *
+format_time(char *buffer, size_t len, time_t t)
+{
+    struct tm tm;
+
+    if ( t == 0 || ! localtime_r(&t, &tm) )
+        snprintf(buffer, len, "-");
+    else
+        strftime(buffer, len, "%Y-%m-%d %H:%M", &tm);
+
+    return buffer;
+}
+
+static void
+free_caches(odk_cache_t *caches, size_t n)
+{
+    for ( size_t i = 0; i < n; i++ ) {
+        for ( size_t j = 0; j < caches[i].n_items; j++ ) {
+            free(caches[i].items[j].path);
+            free(caches[i].items[j].link);
+        }
+        free(caches[i].items);
+    }
+}
+
+/* Sorts cache items from the least to the most recently used. */
+static int
+compare_items(const void *a, const void *b)
+{
+    const cache_item_t *ia = a, *ib = b;
+
+    return ia->last_use < ib->last_use ? -1 : ia->last_use > ib->last_use;
+}
+
+#define MAX_CACHES  8
+
+#endif /* !ODK_RUNNER_WINDOWS */
+
+/**
+ * Prints the size, hit rate, and last use of all the caches known to
+ * the runner, then the disk usage reported by Docker.
+ *
+ * @param cfg The ODK configuration.
+ *
+ * @return 0 if successful, or -1 if an error occured.
+ */
+int
+odk_cache_stats(odk_run_config_t *cfg)
+{
+#if defined(ODK_RUNNER_WINDOWS)
+    (void) cfg;
+    errno = ENOSYS;
+    return -1;
+#else
+    odk_cache_t caches[MAX_CACHES];
+    size_t n;
+    char size[16], budget[16], last_use[32], hit_rate[16];
+    char *docker_argv[] = { "docker", "system", "df", NULL };
+
+    n = find_caches(cfg, caches);
+    printf("%-12s %10s %7s %8s %-16s %10s  %s\n",
+           "CACHE", "SIZE", "ITEMS", "HIT RATE", "LAST USE", "BUDGET", "PATH");
+    for ( size_t i = 0; i < n; i++ ) {
+        odk_cache_t *cache = &caches[i];
+
+        scan_cache(cache);
+        if ( strcmp(cache->name, "sparql") == 0 ) {
+            odk_sparql_stats_t stats;
+
+            odk_sparql_store_get_stats(&stats);
+            if ( stats.hits + stats.loads > 0 )
+                cache->hit_rate = (int)(stats.hits * 100 / (stats.hits + stats.loads));
+        }
+
+        if ( cache->hit_rate >= 0 )
+            snprintf(hit_rate, sizeof(hit_rate), "%d%%", cache->hit_rate);
+        else
+            snprintf(hit_rate, sizeof(hit_rate), "-");
+        if ( cache->budget_var )
+            format_size(budget, sizeof(budget), get_budget(cfg, cache));
+        else
+            snprintf(budget, sizeof(budget), "stale");
+
+        printf("%-12s %10s %7lu %8s %-16s %10s  %s\n", cache->name,
+               format_size(size, sizeof(size), cache->size),
+               (unsigned long)cache->n_items, hit_rate,
+               format_time(last_use, sizeof(last_use), cache->last_use),
+               budget, cache->path);
+    }
+    free_caches(caches, n);
+    fflush(stdout);
+
+    if ( spawn_process(docker_argv, NULL) == 0 )
+        putchar('\n');
+
+    return 0;
+#endif
+}
+
+/**
+ * Trims all the caches known to the runner to their budget, removing
+ * the least recently used items first, and removes stale state
+ * directories. The caches of the current repository are left alone if
+ * a command is running in that repository, and the shared caches if a
+ * command is using them.
+ *
+ * @param cfg   The ODK configuration.
+ * @param flags ODK_CACHE_GC_DRYRUN to only print what would be removed;
+ *              ODK_CACHE_GC_PRUNE to also prune all dangling Docker
+ *              images (not only those of the ODK).
+ *
+ * @return 0 if successful, or -1 if some items could not be removed.
+ */
+int
+odk_cache_gc(odk_run_config_t *cfg, int flags)
+{
+#if defined(ODK_RUNNER_WINDOWS)
+    (void) cfg;
+    (void) flags;
+    errno = ENOSYS;
+    return -1;
+#else
+    odk_cache_t caches[MAX_CACHES];
+    size_t n;
+    int dry_run = flags & ODK_CACHE_GC_DRYRUN;
+    int ret = 0, repo_lock = -1, repo_busy = 0, cache_lock;
+    char freed_str[16], size_str[16];
+    char *docker_argv[] = { "docker", "image", "prune", "--force", NULL };
+
+    n = find_caches(cfg, caches);
+    for ( size_t i = 0; i < n; i++ ) {
+        odk_cache_t *cache = &caches[i];
+        unsigned long long budget, freed = 0;
+        size_t removed = 0;
+
+        if ( cache->in_repo && ! dry_run && repo_lock == -1 ) {
+            if ( repo_busy || (repo_lock = odk_repository_lock(1)) == -1 ) {
+                if ( ! repo_busy )
+                    fprintf(stderr, "odkrun: Not trimming the caches of the repository: %s\n",
+                            errno == EWOULDBLOCK ? "a command is running" : strerror(errno));
+                repo_busy = 1;
+                continue;
+            }
+        }
+
+        cache_lock = -1;
+        if ( ! cache->in_repo && cache->mode != CACHE_STALE && ! dry_run
+                && (cache_lock = odk_cache_lock(cache->path, 1)) == -1 ) {
+            fprintf(stderr, "odkrun: Not trimming the %s cache: %s\n", cache->name,
+                    errno == EWOULDBLOCK ? "a command is using it" : strerror(errno));
+            continue;
+        }
+
+        scan_cache(cache);
+        budget = get_budget(cfg, cache);
+        qsort(cache->items, cache->n_items, sizeof(cache_item_t), compare_items);
+
+        for ( size_t j = 0; j < cache->n_items; j++ ) {
+            cache_item_t *item = &(cache->items[j]);
+
+            if ( cache->mode != CACHE_STALE && cache->size - freed <= budget )
+                break;
+
+            if ( dry_run )
+                printf("Would remove %s (%s)\n", item->path, format_size(size_str, sizeof(size_str), item->size));
+            else if ( (item->link && unlink(item->link) == -1) || remove_tree(item->path) == -1 ) {
+                fprintf(stderr, "odkrun: Cannot remove %s: %s\n", item->path, strerror(errno));
+                ret = -1;
+                continue;
+            }
+            freed += item->size;
+            removed += 1;
+        }
+
+        if ( removed > 0 )
+            printf("%s: %s %lu item(s), %s\n", cache->name, dry_run ? "would remove" : "removed",
+                   (unsigned long)removed, format_size(freed_str, sizeof(freed_str), freed));
+        odk_unlock(cache_lock);
+    }
+    free_caches(caches, n);
+    odk_unlock(repo_lock);
+    fflush(stdout);
+
+    if ( flags & ODK_CACHE_GC_PRUNE ) {
+        if ( dry_run )
+            printf("Would prune dangling Docker images\n");
+        else
+            spawn_process(docker_argv, NULL);
+    }
+
+    return ret;
+#endif
+}
+
+/**
+ * Takes a shared lock on each of the caches shared between repositories
+ * that a command is going to use, so that they are not trimmed while it
+ * is running: the user's OAK cache (when it is shared, or when running
+ * natively), the native toolchains, and the Singularity cache.
+ *
+ * @param cfg     The ODK configuration.
+ * @param backend The name of the backend running the command.
+ * @param locks   The object to store the locks into; to be released
+ *                with odk_cache_release.
+ */
+void
+odk_cache_use(odk_run_config_t *cfg, const char *backend, odk_cache_locks_t *locks)
+{
+    locks->count = 0;
+#if defined(ODK_RUNNER_WINDOWS)
+    (void) cfg;
+    (void) backend;
+#else
+    odk_cache_t caches[MAX_CACHES];
+    const char *oak = cfg->oak_cache_directory;
+    size_t n;
+    int used, fd;
+
+    if ( ! backend )
+        backend = "";
+
+    n = find_caches(cfg, caches);
+    for ( size_t i = 0; i < n; i++ ) {
+        const char *name = caches[i].name;
+
+        if ( strcmp(name, "oak") == 0 )
+            used = strcmp(backend, "native") == 0
+                || (oak && strcasecmp(oak, ODK_SHARING_OAKLIB_REPO_CACHE) != 0);
+        else if ( strcmp(name, "native") == 0 )
+            used = strcmp(backend, "native") == 0;
+        else if ( strcmp(name, "singularity") == 0 || strcmp(name, "apptainer") == 0 )
+            used = strcmp(backend, "singularity") == 0;
+        else
+            used = 0;
+
+        if ( used && locks->count < sizeof(locks->fds) / sizeof(int) ) {
+            if ( (fd = odk_cache_lock(caches[i].path, 0)) == -1 )
+                fprintf(stderr, "odkrun: Cannot lock the %s cache: %s\n", name, strerror(errno));
+            else
+                locks->fds[locks->count++] = fd;
+        }
+    }
+    free_caches(caches, n);
+#endif
+}
+
+/**
+ * Releases the locks obtained with odk_cache_use.
+ *
+ * @param locks The locks to release.
+ */
+void
+odk_cache_release(odk_cache_locks_t *locks)
+{
+    for ( size_t i = 0; i < locks->count; i++ )
+        odk_unlock(locks->fds[i]);
+    locks->count = 0;
+}
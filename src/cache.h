@@ -0,0 +1,65 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ICP20261018_CACHE_H
+#define ICP20261018_CACHE_H
+
+#include "runner.h"
+
+/* Locks on the shared caches used by a command. */
+typedef struct odk_cache_locks {
+    int     fds[4];
+    size_t  count;
+} odk_cache_locks_t;
+
+#define ODK_CACHE_GC_DRYRUN 0x0001
+#define ODK_CACHE_GC_PRUNE  0x0002
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int
+odk_cache_stats(odk_run_config_t *);
+
+int
+odk_cache_gc(odk_run_config_t *, int);
+
+void
+odk_cache_use(odk_run_config_t *, const char *, odk_cache_locks_t *);
+
+void
+odk_cache_release(odk_cache_locks_t *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !ICP20261018_CACHE_H */
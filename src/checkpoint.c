@@ -0,0 +1,797 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "checkpoint.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+
+#if defined(ODK_RUNNER_LINUX)
+#include <fcntl.h>
+#include <glob.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif
+
+#include <xmem.h>
+#include <memreg.h>
+
+#include "backend-docker.h"
+#include "procutil.h"
+#include "util.h"
+
+/*
+ * Checkpoint/restore of warmed containers.
+ *
+ * For repeated runs on a large ontology, much of the time goes to
+ * starting the JVM and warming it up rather than to the actual work.
+ * In checkpoint mode, the command is run in a container whose entry
+ * point (1) starts a ROBOT server, a JVM that runs all the ROBOT
+ * commands of the container (a 'robot' shim forwards them to it),
+ * (2) runs an optional warm-up command (ODK_CHECKPOINT_WARMUP) to
+ * get classes loaded and code JIT-compiled, and (3) waits for the
+ * actual command to run. Once the container is warm, it is
+ * checkpointed with 'docker checkpoint' (which requires CRIU and the
+ * experimental features of the Docker daemon) before being given the
+ * command. Later runs restore the container from that checkpoint
+ * instead of starting it cold.
+ *
+ * Checkpoints are keyed by the image ID, the container configuration
+ * (bindings and environment), and the contents of the input files
+ * (the files matching the patterns in ODK_CHECKPOINT_INPUTS, by
+ * default the edit file and the imports), so that a change to any of
+ * them triggers a new cold start. They are stored along with their
+ * scripts in ODK_CHECKPOINT_DIR/KEY; the command and its output go
+ * through files and FIFOs in that directory, since the standard
+ * streams of a restored container belong to the original one.
+ *
+ * Anything that goes wrong with the checkpoint itself (the Docker
+ * daemon not supporting it, a checkpoint that cannot be restored) is
+ * reported and the command runs without it.
+ */
+
+#if defined(ODK_RUNNER_LINUX)
+
+#define DEFAULT_INPUTS  "*-edit.owl *-edit.obo *-edit.ofn imports/*_import.owl"
+#define CHECKPOINT_NAME "warm"
+
+/* Entry point of the container. Starts the ROBOT server, runs the
+ * warm-up command, then waits for the actual command. The output of
+ * the server is discarded: a file still open in the checkpoint
+ * directory when the checkpoint is created would no longer match on
+ * restore, as the directory keeps changing afterwards. */
+static const char *warm_script = "\
+dir=$(cd \"$(dirname \"$0\")\" && pwd)\n\
+request=$dir/request\n\
+rm -f \"$dir/ready\" \"$dir/port\"\n\
+pwd > \"$dir/cwd\"\n\
+PATH=$dir/bin:$PATH\n\
+export PATH\n\
+\n\
+if [ -f /tools/robot.jar ]; then\n\
+    java $ROBOT_JAVA_ARGS -XX:-UsePerfData -cp /tools/robot.jar \\\n\
+        \"$dir/RobotServer.java\" \"$dir/port\" > /dev/null 2>&1 &\n\
+    n=0\n\
+    while [ ! -f \"$dir/port\" ] && [ $n -lt 600 ] && kill -0 $! 2> /dev/null; do\n\
+        sleep 0.1\n\
+        n=$((n + 1))\n\
+    done\n\
+fi\n\
+if [ -n \"$ODK_CHECKPOINT_WARMUP\" ]; then\n\
+    sh -c \"$ODK_CHECKPOINT_WARMUP\" > /dev/null 2>&1 < /dev/null\n\
+fi\n\
+touch \"$dir/ready\"\n\
+\n\
+while [ ! -f \"$request/command\" ]; do\n\
+    sleep 0.1\n\
+done\n\
+sh \"$request/command\" > \"$request/stdout\" 2> \"$request/stderr\" < /dev/null\n\
+echo $? > \"$request/status.tmp\"\n\
+mv \"$request/status.tmp\" \"$request/status\"\n\
+";
+
+/* Sends ROBOT commands to the server when possible. */
+static const char *robot_shim = "\
+bin=$(cd \"$(dirname \"$0\")\" && pwd)\n\
+dir=$(dirname \"$bin\")\n\
+if [ -f \"$dir/port\" ] && [ \"$(pwd)\" = \"$(cat \"$dir/cwd\" 2> /dev/null)\" ]; then\n\
+    exec python3 \"$bin/odkrun-robot-client\" \"$(cat \"$dir/port\")\" \"$@\"\n\
+fi\n\
+PATH=$(printf ':%s:' \"$PATH\" | sed \"s|:$bin:|:|g; s|^:||; s|:$||\")\n\
+export PATH\n\
+exec robot \"$@\"\n\
+";
+
+/* Client side of the ROBOT server protocol. */
+static const char *robot_client = "\
+import os\n\
+import socket\n\
+import struct\n\
+import sys\n\
+\n\
+\n\
+def fallback(args):\n\
+    bindir = os.path.dirname(os.path.abspath(__file__))\n\
+    path = os.environ.get('PATH', '').split(':')\n\
+    os.environ['PATH'] = ':'.join(p for p in path if p and os.path.abspath(p) != bindir)\n\
+    os.execvp('robot', ['robot'] + args)\n\
+\n\
+\n\
+def receive(sock, n):\n\
+    data = b''\n\
+    while len(data) < n:\n\
+        chunk = sock.recv(n - len(data))\n\
+        if not chunk:\n\
+            return None\n\
+        data += chunk\n\
+    return data\n\
+\n\
+\n\
+def main():\n\
+    port, args = int(sys.argv[1]), sys.argv[2:]\n\
+    if any('\\n' in arg for arg in args):\n\
+        fallback(args)\n\
+    try:\n\
+        sock = socket.create_connection(('127.0.0.1', port))\n\
+    except OSError:\n\
+        fallback(args)\n\
+    request = '%d\\n' % len(args) + ''.join(arg + '\\n' for arg in args)\n\
+    sock.sendall(request.encode('utf-8', 'surrogateescape'))\n\
+    outputs = {1: sys.stdout.buffer, 2: sys.stderr.buffer}\n\
+    while True:\n\
+        header = receive(sock, 5)\n\
+        if header is None:\n\
+            sys.stderr.write('robot: lost connection to the ROBOT server\\n')\n\
+            return 1\n\
+        channel, length = struct.unpack('>BI', header)\n\
+        data = receive(sock, length)\n\
+        if data is None:\n\
+            sys.stderr.write('robot: lost connection to the ROBOT server\\n')\n\
+            return 1\n\
+        if channel == 0:\n\
+            return struct.unpack('>i', data)[0]\n\
+        outputs[channel].write(data)\n\
+        outputs[channel].flush()\n\
+\n\
+\n\
+sys.exit(main())\n\
+";
+
+/* The ROBOT server itself, run from source (requires a JDK 11+). */
+static const char *robot_server = "\
+import java.io.BufferedOutputStream;\n\
+import java.io.BufferedReader;\n\
+import java.io.DataOutputStream;\n\
+import java.io.IOException;\n\
+import java.io.InputStreamReader;\n\
+import java.io.OutputStream;\n\
+import java.io.PrintStream;\n\
+import java.net.InetAddress;\n\
+import java.net.ServerSocket;\n\
+import java.net.Socket;\n\
+import java.nio.charset.StandardCharsets;\n\
+import java.nio.file.Files;\n\
+import java.nio.file.Path;\n\
+import java.nio.file.Paths;\n\
+import java.nio.file.StandardCopyOption;\n\
+\n\
+import org.obolibrary.robot.CommandLineInterface;\n\
+import org.obolibrary.robot.ExceptionHelper;\n\
+\n\
+/*\n\
+ * Runs ROBOT commands received on a local socket within a single JVM.\n\
+ * Each request is a line with the number of arguments followed by one\n\
+ * line per argument; the server replies with frames made of a channel\n\
+ * byte (1 for stdout, 2 for stderr, 0 for the exit code), a 4-byte\n\
+ * length, and the data. ROBOT is not meant to run several commands\n\
+ * at once in the same JVM (it keeps global state), so requests are\n\
+ * executed one at a time.\n\
+ */\n\
+public class RobotServer {\n\
+\n\
+    private static final InheritableThreadLocal<OutputStream> OUT = new InheritableThreadLocal<>();\n\
+    private static final InheritableThreadLocal<OutputStream> ERR = new InheritableThreadLocal<>();\n\
+    private static final Object LOCK = new Object();\n\
+\n\
+    /* Sends the output of a thread to its own request. */\n\
+    private static PrintStream dispatch(InheritableThreadLocal<OutputStream> target, PrintStream fallback) {\n\
+        return new PrintStream(new OutputStream() {\n\
+            public void write(int b) throws IOException {\n\
+                write(new byte[] { (byte) b }, 0, 1);\n\
+            }\n\
+\n\
+            public void write(byte[] b, int off, int len) throws IOException {\n\
+                OutputStream os = target.get();\n\
+                if ( os != null )\n\
+                    os.write(b, off, len);\n\
+                else\n\
+                    fallback.write(b, off, len);\n\
+            }\n\
+\n\
+            public void flush() throws IOException {\n\
+                OutputStream os = target.get();\n\
+                if ( os != null )\n\
+                    os.flush();\n\
+                else\n\
+                    fallback.flush();\n\
+            }\n\
+        }, true);\n\
+    }\n\
+\n\
+    private static class Channel extends OutputStream {\n\
+        private final DataOutputStream conn;\n\
+        private final int id;\n\
+\n\
+        Channel(DataOutputStream conn, int id) {\n\
+            this.conn = conn;\n\
+            this.id = id;\n\
+        }\n\
+\n\
+        public void write(int b) throws IOException {\n\
+            write(new byte[] { (byte) b }, 0, 1);\n\
+        }\n\
+\n\
+        public void write(byte[] b, int off, int len) throws IOException {\n\
+            synchronized ( conn ) {\n\
+                conn.writeByte(id);\n\
+                conn.writeInt(len);\n\
+                conn.write(b, off, len);\n\
+            }\n\
+        }\n\
+\n\
+        public void flush() throws IOException {\n\
+            synchronized ( conn ) {\n\
+                conn.flush();\n\
+            }\n\
+        }\n\
+    }\n\
+\n\
+    private static void handle(Socket socket) {\n\
+        try ( Socket s = socket ) {\n\
+            BufferedReader in = new BufferedReader(new InputStreamReader(s.getInputStream(), StandardCharsets.UTF_8));\n\
+            DataOutputStream conn = new DataOutputStream(new BufferedOutputStream(s.getOutputStream()));\n\
+            String[] args = new String[Integer.parseInt(in.readLine())];\n\
+            int status = 0;\n\
+\n\
+            for ( int i = 0; i < args.length; i++ )\n\
+                args[i] = in.readLine();\n\
+\n\
+            OUT.set(new Channel(conn, 1));\n\
+            ERR.set(new Channel(conn, 2));\n\
+            synchronized ( LOCK ) {\n\
+                try {\n\
+                    CommandLineInterface.execute(args);\n\
+                } catch ( Exception e ) {\n\
+                    ExceptionHelper.handleException(e);\n\
+                    status = 1;\n\
+                }\n\
+                System.out.flush();\n\
+                System.err.flush();\n\
+            }\n\
+\n\
+            synchronized ( conn ) {\n\
+                conn.writeByte(0);\n\
+                conn.writeInt(4);\n\
+                conn.writeInt(status);\n\
+                conn.flush();\n\
+            }\n\
+        } catch ( IOException | RuntimeException e ) {\n\
+            /* Client went away, nothing to report to. */\n\
+        } finally {\n\
+            OUT.remove();\n\
+            ERR.remove();\n\
+        }\n\
+    }\n\
+\n\
+    public static void main(String[] args) throws IOException {\n\
+        ServerSocket server = new ServerSocket(0, 50, InetAddress.getLoopbackAddress());\n\
+        Path tmp = Paths.get(args[0] + \".tmp\");\n\
+\n\
+        System.setOut(dispatch(OUT, System.out));\n\
+        System.setErr(dispatch(ERR, System.err));\n\
+\n\
+        Files.write(tmp, Integer.toString(server.getLocalPort()).getBytes(StandardCharsets.US_ASCII));\n\
+        Files.move(tmp, Paths.get(args[0]), StandardCopyOption.ATOMIC_MOVE);\n\
+\n\
+        while ( true ) {\n\
+            Socket socket = server.accept();\n\
+            new Thread(() -> handle(socket)).start();\n\
+        }\n\
+    }\n\
+}\n\
+";
+
+/* Gets the value of a setting from the configuration. */
+static const char *
+get_setting(odk_run_config_t *cfg, const char *name)
+{
+    const char *value = NULL;
+
+    for ( size_t i = 0; i < cfg->n_env_vars; i++ )
+        if ( strcmp(cfg->env_vars[i].name, name) == 0 )
+            value = cfg->env_vars[i].value;
+
+    return value;
+}
+
+/* Hashes the contents of a file. */
+static unsigned long long
+hash_file(unsigned long long hash, const char *path)
+{
+    FILE *f;
+    char buffer[65536];
+    size_t n;
+
+    hash = hash_fnv1a(hash, path, strlen(path));
+    if ( (f = fopen(path, "r")) ) {
+        while ( (n = fread(buffer, 1, sizeof(buffer), f)) > 0 )
+            hash = hash_fnv1a(hash, buffer, n);
+        fclose(f);
+    }
+
+    return hash;
+}
+
+/*
+ * Computes the key of the checkpoint for a given container command
+ * line. Returns 0 if the key cannot be computed (the image is not
+ * available locally).
+ */
+static unsigned long long
+get_key(odk_run_config_t *cfg, char **create_argv)
+{
+    unsigned long long hash = FNV1A_INIT;
+    const char *inputs;
+    char *command, *image_id, *copy, *pattern, *saveptr;
+    glob_t files;
+
+    xasprintf(&command, "docker image inspect --format={{.Id}} %s%s:%s",
+              strchr(cfg->image_name, '/') ? "" : "obolibrary/", cfg->image_name, cfg->image_tag);
+    image_id = read_line_from_pipe(command);
+    free(command);
+    if ( ! image_id )
+        return 0;
+    hash = hash_fnv1a(hash, image_id, strlen(image_id));
+    free(image_id);
+
+    /* The container ID file may differ from one run to the other. */
+    for ( char **arg = create_argv; *arg; arg++ )
+        if ( strncmp(*arg, "--cidfile=", 10) != 0 )
+            hash = hash_fnv1a(hash, *arg, strlen(*arg) + 1);
+
+    if ( ! (inputs = get_setting(cfg, "ODK_CHECKPOINT_INPUTS")) )
+        inputs = DEFAULT_INPUTS;
+    copy = xstrdup(inputs);
+    for ( pattern = strtok_r(copy, " ", &saveptr); pattern; pattern = strtok_r(NULL, " ", &saveptr) ) {
+        if ( glob(pattern, 0, NULL, &files) == 0 ) {
+            for ( size_t i = 0; i < files.gl_pathc; i++ )
+                hash = hash_file(hash, files.gl_pathv[i]);
+            globfree(&files);
+        }
+    }
+    free(copy);
+
+    return hash ? hash : 1;
+}
+
+/* Writes one of the scripts of a checkpoint. */
+static int
+write_script(const char *directory, const char *name, const char *prefix, const char *script)
+{
+    FILE *f;
+    char *path;
+    int ret = 0;
+
+    xasprintf(&path, "%s/%s", directory, name);
+    if ( (f = fopen(path, "w")) ) {
+        fprintf(f, "%s%s", prefix, script);
+        if ( fclose(f) == EOF || chmod(path, 0755) == -1 )
+            ret = -1;
+    } else
+        ret = -1;
+    free(path);
+
+    return ret;
+}
+
+/* Reads the first line of a small file; returns NULL if it does not
+ * exist. */
+static char *
+read_small_file(const char *path)
+{
+    FILE *f;
+    char buffer[256], *line = NULL;
+
+    if ( (f = fopen(path, "r")) ) {
+        if ( fgets(buffer, sizeof(buffer), f) ) {
+            buffer[strcspn(buffer, "\n")] = '\0';
+            line = xstrdup(buffer);
+        }
+        fclose(f);
+    }
+
+    return line;
+}
+
+/* Runs a Docker command, discarding its standard output. */
+static int
+docker(char **argv)
+{
+    odk_process_t proc;
+
+    if ( start_process(argv, PROCESS_QUIET, &proc) == -1 )
+        return -1;
+
+    return wait_process(&proc, NULL);
+}
+
+/* Checks whether a container is still running. */
+static int
+is_running(const char *cid)
+{
+    char *command, *state;
+    int running;
+
+    xasprintf(&command, "docker container inspect --format={{.State.Running}} %s", cid);
+    state = read_line_from_pipe(command);
+    running = state && strcmp(state, "true") == 0;
+    free(state);
+    free(command);
+
+    return running;
+}
+
+/* Waits for the container to be ready to be checkpointed. */
+static int
+wait_ready(const char *directory, const char *cid)
+{
+    char *ready;
+    int ret = -1;
+    unsigned n;
+
+    xasprintf(&ready, "%s/ready", directory);
+    for ( n = 0; ret == -1; n++ ) {
+        if ( file_exists(ready) == 0 )
+            ret = 0;
+        else if ( n % 20 == 19 && ! is_running(cid) )
+            break;
+        else
+            usleep(100000);
+    }
+    free(ready);
+
+    return ret;
+}
+
+/* Writes the command to run as a shell script, for the container to
+ * pick it up. */
+static int
+send_command(const char *request, const char *work_directory, char **command)
+{
+    FILE *f;
+    char *path, *tmp;
+    int ret = 0;
+
+    xasprintf(&path, "%s/command", request);
+    xasprintf(&tmp, "%s/command.tmp", request);
+    if ( (f = fopen(tmp, "w")) ) {
+        fprintf(f, "cd '%s' || exit 1\nexec", work_directory);
+        for ( char **arg = command; *arg; arg++ ) {
+            fputs(" '", f);
+            for ( const char *c = *arg; *c; c++ ) {
+                if ( *c == '\'' )
+                    fputs("'\\''", f);
+                else
+                    fputc(*c, f);
+            }
+            fputc('\'', f);
+        }
+        fputc('\n', f);
+        if ( fclose(f) == EOF || rename(tmp, path) == -1 )
+            ret = -1;
+    } else
+        ret = -1;
+    free(tmp);
+    free(path);
+
+    return ret;
+}
+
+/*
+ * Copies the output of the command from the request FIFOs to our own
+ * standard streams, until the command has finished. Returns the exit
+ * code of the command.
+ */
+static int
+relay_output(const char *request, const char *cid)
+{
+    struct pollfd fds[2];
+    char *path, buffer[65536], *status = NULL;
+    int targets[2] = { STDOUT_FILENO, STDERR_FILENO };
+    const char *names[2] = { "stdout", "stderr" };
+    unsigned n = 0;
+    int rc = -1;
+
+    for ( int i = 0; i < 2; i++ ) {
+        xasprintf(&path, "%s/%s", request, names[i]);
+        fds[i].fd = open(path, O_RDONLY | O_NONBLOCK);
+        fds[i].events = POLLIN;
+        free(path);
+    }
+    xasprintf(&path, "%s/status", request);
+
+    while ( ! status ) {
+        int got = 0, done;
+        ssize_t len;
+
+        poll(fds, 2, 200);
+        for ( int i = 0; i < 2; i++ ) {
+            while ( fds[i].fd != -1 && (len = read(fds[i].fd, buffer, sizeof(buffer))) > 0 ) {
+                if ( write(targets[i], buffer, len) != len )
+                    break;
+                got = 1;
+            }
+        }
+
+        /* The status is written after the command's output is
+         * closed, so everything has been read when it appears. */
+        done = file_exists(path) == 0;
+        if ( done ) {
+            for ( int i = 0; i < 2; i++ )
+                while ( fds[i].fd != -1 && (len = read(fds[i].fd, buffer, sizeof(buffer))) > 0 )
+                    if ( write(targets[i], buffer, len) != len )
+                        break;
+            status = read_small_file(path);
+        } else if ( ! got ) {
+            if ( ++n % 25 == 0 && ! is_running(cid) )
+                break;
+            usleep(20000);
+        }
+    }
+
+    if ( status ) {
+        rc = atoi(status);
+        free(status);
+    } else
+        errno = ECHILD;
+
+    for ( int i = 0; i < 2; i++ )
+        if ( fds[i].fd != -1 )
+            close(fds[i].fd);
+    free(path);
+
+    return rc;
+}
+
+/* Prepares the request directory for a new command. */
+static int
+reset_request(const char *request)
+{
+    const char *files[] = { "command", "command.tmp", "stdout", "stderr", "status", "status.tmp", NULL };
+    char *path;
+    int ret = 0;
+
+    if ( create_directory(request) == -1 )
+        return -1;
+
+    for ( const char **file = files; *file; file++ ) {
+        xasprintf(&path, "%s/%s", request, *file);
+        unlink(path);
+        if ( strcmp(*file, "stdout") == 0 || strcmp(*file, "stderr") == 0 )
+            if ( mkfifo(path, 0666) == -1 )
+                ret = -1;
+        free(path);
+    }
+
+    return ret;
+}
+
+/* Runs the command in a container created from the checkpoint
+ * directory, restoring it or creating the checkpoint as needed.
+ * Returns the exit code of the command, or -1 if it could not be
+ * started at all. */
+static int
+run_checkpointed(odk_run_config_t *cfg, odk_backend_t *backend, const char *directory, char **command)
+{
+    char *entry[3], **create_argv, *criu, *criu_abs, *request, *cid = NULL, *cid_file;
+    char *start_argv[8], *rm_argv[5];
+    const char *saved_cid_file = cfg->container_id_file, *outcome = "not created";
+    double t_start = get_monotonic_time();
+    int restore, rc = -1;
+
+    xasprintf(&criu, "%s/criu", directory);
+    xasprintf(&request, "%s/request", directory);
+    restore = file_exists(mr_sprintf(&cfg->mr, "%s/" CHECKPOINT_NAME, criu)) == 0;
+    if ( create_directory(criu) == -1 || ! (criu_abs = realpath(criu, NULL)) ) {
+        free(criu);
+        free(request);
+        return -1;
+    }
+
+    /* Create the container. */
+    entry[0] = "sh";
+    entry[1] = mr_sprintf(&cfg->mr, "%s/%s/warm", cfg->work_directory, directory);
+    entry[2] = NULL;
+    if ( ! cfg->container_id_file )
+        cfg->container_id_file = mr_sprintf(&cfg->mr, "%s/cid", directory);
+    cid_file = (char *)cfg->container_id_file;
+    unlink(cid_file);
+    create_argv = odk_backend_docker_create_command(cfg, entry);
+    cfg->container_id_file = saved_cid_file;
+
+    if ( reset_request(request) == -1 || docker(create_argv) != 0 || ! (cid = read_small_file(cid_file)) )
+        goto out;
+
+    rm_argv[0] = "docker";
+    rm_argv[1] = "rm";
+    rm_argv[2] = "--force";
+    rm_argv[3] = cid;
+    rm_argv[4] = NULL;
+
+    start_argv[0] = "docker";
+    start_argv[1] = "start";
+    if ( restore ) {
+        start_argv[2] = mr_sprintf(&cfg->mr, "--checkpoint-dir=%s", criu_abs);
+        start_argv[3] = "--checkpoint=" CHECKPOINT_NAME;
+        start_argv[4] = cid;
+        start_argv[5] = NULL;
+        if ( docker(start_argv) != 0 ) {
+            char *rm_checkpoint_argv[] = {
+                "rm", "-rf", mr_sprintf(&cfg->mr, "%s/" CHECKPOINT_NAME, criu), NULL
+            };
+
+            warnx("Cannot restore checkpoint, starting cold");
+            spawn_process(rm_checkpoint_argv, NULL);
+            restore = 0;
+        } else
+            outcome = "restored";
+    }
+    if ( ! restore ) {
+        /* Files left by a previous run must not make us believe that
+         * the new container is already warmed up. */
+        unlink(mr_sprintf(&cfg->mr, "%s/ready", directory));
+        unlink(mr_sprintf(&cfg->mr, "%s/port", directory));
+
+        start_argv[2] = cid;
+        start_argv[3] = NULL;
+        if ( docker(start_argv) != 0 )
+            goto out_rm;
+
+        if ( wait_ready(directory, cid) == 0 ) {
+            char *checkpoint_argv[] = {
+                "docker", "checkpoint", "create", "--leave-running",
+                mr_sprintf(&cfg->mr, "--checkpoint-dir=%s", criu_abs),
+                cid, CHECKPOINT_NAME, NULL
+            };
+
+            if ( docker(checkpoint_argv) != 0 ) {
+                warnx("Cannot checkpoint container, running without checkpoint");
+                outcome = "failed";
+            } else
+                outcome = "created";
+        } else
+            goto out_rm;
+    }
+
+    if ( send_command(request, cfg->work_directory, command) == 0 ) {
+        /* From now on, the command has been handed over; whatever
+         * happens, it must not be run again. */
+        if ( (rc = relay_output(request, cid)) == -1 ) {
+            warnx("Lost container before the command completed");
+            rc = 1;
+        }
+    }
+
+out_rm:
+    docker(rm_argv);
+out:
+    if ( cfg->flags & ODK_FLAG_TIMEDEBUG )
+        fprintf(stderr, "### CHECKPOINT STATS ###\n"
+                "Checkpoint: %s\n"
+                "Elapsed time: %.2f s\n",
+                outcome, get_monotonic_time() - t_start);
+    backend->last_run.available = ODK_STATS_WALLTIME;
+    backend->last_run.wall_time = get_monotonic_time() - t_start;
+    backend->last_run.killed = rc == 137;   /* As reported by the shell */
+    free(cid);
+    free(criu_abs);
+    free(criu);
+    free(request);
+
+    return rc;
+}
+
+#endif /* ODK_RUNNER_LINUX */
+
+/**
+ * Runs a command in a container restored from a checkpoint, creating
+ * the checkpoint first if needed. Falls back to running the command
+ * normally if checkpointing is not possible.
+ *
+ * @param cfg     The ODK configuration.
+ * @param backend The backend in use (must be the Docker backend).
+ * @param command The command to run.
+ *
+ * @return The exit code of the command, or -1 if it could not be run.
+ */
+int
+odk_checkpoint_run(odk_run_config_t *cfg, odk_backend_t *backend, char **command)
+{
+#if defined(ODK_RUNNER_LINUX)
+    char *entry[] = { "sh", ODK_CHECKPOINT_DIR "/warm", NULL };
+    char *directory, *bin, *lock_path;
+    unsigned long long key;
+    int lock, rc;
+
+    if ( ! (key = get_key(cfg, odk_backend_docker_create_command(cfg, entry))) ) {
+        warnx("Cannot identify image, running without checkpoint");
+        return backend->run(backend, cfg, command);
+    }
+
+    directory = mr_sprintf(&cfg->mr, ODK_CHECKPOINT_DIR "/%016llx", key);
+    bin = mr_sprintf(&cfg->mr, "%s/bin", directory);
+    lock_path = mr_sprintf(&cfg->mr, "%s/lock", directory);
+    if ( create_directory(bin) == -1
+            || write_script(directory, "warm", "#!/bin/sh\n", warm_script) == -1
+            || write_script(directory, "RobotServer.java", "", robot_server) == -1
+            || write_script(bin, "robot", "#!/bin/sh\n", robot_shim) == -1
+            || write_script(bin, "odkrun-robot-client", "", robot_client) == -1 ) {
+        warn("Cannot prepare checkpoint, running without checkpoint");
+        return backend->run(backend, cfg, command);
+    }
+
+    /* A checkpoint can only serve one command at a time. */
+    if ( (lock = open(lock_path, O_RDWR | O_CREAT, 0644)) == -1 || flock(lock, LOCK_EX | LOCK_NB) == -1 ) {
+        warnx("Checkpoint already in use, running without checkpoint");
+        if ( lock != -1 )
+            close(lock);
+        return backend->run(backend, cfg, command);
+    }
+
+    if ( (rc = run_checkpointed(cfg, backend, directory, command)) == -1 ) {
+        warn("Cannot run from checkpoint, running without checkpoint");
+        rc = backend->run(backend, cfg, command);
+    }
+    close(lock);
+
+    return rc;
+#else
+    return backend->run(backend, cfg, command);
+#endif
+}
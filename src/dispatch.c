@@ -0,0 +1,282 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "dispatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include <memreg.h>
+
+#include "util.h"
+
+/* Where ~/.ssh is bound within a Docker container. */
+#define DOCKER_SSH_DIR "/home/odkuser/.ssh"
+
+/*
+ * Distributed execution of make recipes.
+ *
+ * When a pool of executors is configured (ODK_EXECUTORS, a
+ * space-separated list of "ssh://[user@]host/path" or "local:/path"
+ * items, each optionally followed by "#N" to allow N concurrent
+ * recipes on that executor), make is given a SHELL wrapper that runs
+ * some recipe lines on the executors instead of locally. Only lines
+ * starting with one of the commands listed in ODK_DISTRIBUTED_COMMANDS
+ * ("robot" by default, since ROBOT does most of the heavy lifting in
+ * a ODK repository) are dispatched; all others, and all lines for
+ * which no executor is free, are run locally as usual.
+ *
+ * For each dispatched line, the wrapper (1) pushes the files named on
+ * the line (plus the catalog, and the imports and components if the
+ * catalog is used) to a per-slot copy of the repository on the
+ * executor, (2) runs the line there -- with odkrun, in the same image,
+ * for remote executors, directly for local ones, (3) pulls back all
+ * the files written by the line. Transfers are done with rsync in
+ * checksum mode, so only files whose contents differ are copied. If
+ * the remote odkrun fails before the line has even started (e.g.
+ * because odkrun or the image is missing on the executor), the line
+ * is run locally instead.
+ *
+ * With the Docker backend, the wrapper runs within the container, so
+ * the SSH configuration of the user (~/.ssh) is made available there,
+ * in addition to the SSH agent socket that the backend forwards.
+ */
+
+static const char *dispatch_script = "\
+state=$(cd \"$(dirname \"$0\")\" && pwd)\n\
+real_shell=$(command -v bash || echo /bin/sh)\n\
+\n\
+flags=\n\
+while [ $# -gt 2 ] && [ \"$1\" != -c ]; do flags=\"$flags $1\"; shift; done\n\
+[ \"$1\" = -c ] || exec $real_shell $flags \"$@\"\n\
+recipe=$2\n\
+run_locally() { exec $real_shell $flags -c \"$recipe\"; }\n\
+quote() { printf \"'%s'\" \"$(printf '%s' \"$1\" | sed \"s/'/'\\\\\\\\''/g\")\"; }\n\
+on_executor() { if [ -n \"$host\" ]; then ssh -o BatchMode=yes \"$host\" \"$1\"; else sh -c \"$1\"; fi; }\n\
+export RSYNC_RSH=\"ssh -o BatchMode=yes\"\n\
+\n\
+set -f\n\
+words=$(printf '%s' \"$recipe\" | tr '\\t\\n' '  ')\n\
+first=${words#\"${words%%[! ]*}\"}\n\
+first=${first%% *}\n\
+case \" ${ODK_DISTRIBUTED_COMMANDS:-robot} \" in *\" $first \"*) ;; *) run_locally ;; esac\n\
+[ -n \"$ODK_EXECUTORS\" ] && [ -n \"$ODKRUN_WORK_ROOT\" ] && command -v rsync > /dev/null || run_locally\n\
+\n\
+# Find a free slot\n\
+n_ex=0 slot=\n\
+for ex in $ODK_EXECUTORS; do\n\
+    n_ex=$((n_ex + 1))\n\
+    n=${ex##*#}; url=${ex%#*}\n\
+    [ \"$n\" = \"$ex\" ] && n=1\n\
+    s=1\n\
+    while [ $s -le $n ]; do\n\
+        if mkdir \"$state/slot-$n_ex-$s\" 2> /dev/null; then slot=$s; break 2; fi\n\
+        s=$((s + 1))\n\
+    done\n\
+done\n\
+[ -n \"$slot\" ] || run_locally\n\
+lock=$state/slot-$n_ex-$slot\n\
+trap 'rmdir \"$lock\"' EXIT\n\
+trap 'exit 130' INT TERM\n\
+\n\
+case $url in\n\
+local:/*) host= dir=${url#local:} ;;\n\
+ssh://*/*) rest=${url#ssh://}; host=${rest%%/*} dir=/${rest#*/} ;;\n\
+*) rmdir \"$lock\"; trap - EXIT; run_locally ;;\n\
+esac\n\
+dest=$dir/slot$slot\n\
+root=$ODKRUN_WORK_ROOT\n\
+rel=${PWD#\"$root\"}; rel=${rel#/}\n\
+\n\
+# Inputs: all existing files named in the recipe, plus what ROBOT may\n\
+# find through the catalog\n\
+inputs=\n\
+set +f\n\
+extra=$(ls catalog-v001.xml *-odk.yaml 2> /dev/null)\n\
+set -f\n\
+for w in $words $extra; do\n\
+    case $w in -*|*=*) continue ;; esac\n\
+    [ -e \"$w\" ] || continue\n\
+    p=$(cd \"$(dirname \"$w\")\" && pwd)/${w##*/}\n\
+    case $p in \"$root\"/*) inputs=\"$inputs ${p#\"$root\"/}\" ;; esac\n\
+done\n\
+case $recipe in *--catalog*)\n\
+    for d in imports components; do [ -d \"$d\" ] && inputs=\"$inputs ${rel:+$rel/}$d\"; done ;;\n\
+esac\n\
+\n\
+if on_executor \"mkdir -p $(quote \"$dest/$rel\") && rm -f $(quote \"$dest/$rel/.odkrun-started\")\" && (cd \"$root\" && rsync -aR --checksum $inputs \"${host:+$host:}$dest/\") \\\n\
+        && on_executor \"touch $(quote \"$dest/.odkrun-marker\")\"; then\n\
+    if [ -n \"$host\" ]; then\n\
+        on_executor \"cd $(quote \"$dest/$rel\") && odkrun --image $(quote \"$ODKRUN_IMAGE\") --tag $(quote \"$ODKRUN_TAG\") $real_shell $flags -c $(quote \": > .odkrun-started; $recipe\")\"\n\
+        rc=$?\n\
+        if [ $rc -ne 0 ] && ! on_executor \"test -e $(quote \"$dest/$rel/.odkrun-started\")\"; then\n\
+            echo \"Cannot start odkrun on executor $url, running locally\" >&2\n\
+            rmdir \"$lock\"; trap - EXIT\n\
+            run_locally\n\
+        fi\n\
+    else\n\
+        (cd \"$dest/$rel\" && $real_shell $flags -c \"$recipe\")\n\
+        rc=$?\n\
+    fi\n\
+\n\
+    # Outputs: everything written by the recipe\n\
+    on_executor \"cd $(quote \"$dest\") && find . -type f -newer .odkrun-marker ! -name .odkrun-marker ! -name .odkrun-started\" \\\n\
+        | rsync -a --checksum --files-from=- \"${host:+$host:}$dest/\" \"$root/\" || rc=1\n\
+    exit $rc\n\
+fi\n\
+\n\
+echo \"Cannot use executor $url, running locally\" >&2\n\
+rmdir \"$lock\"; trap - EXIT\n\
+run_locally\n\
+";
+
+/* Gets a variable from the configuration. */
+static const char *
+get_cfg_var(odk_run_config_t *cfg, const char *name)
+{
+    for ( size_t i = 0; i < cfg->n_env_vars; i++ )
+        if ( strcmp(cfg->env_vars[i].name, name) == 0 )
+            return cfg->env_vars[i].value;
+
+    return NULL;
+}
+
+/* Gets the host directory bound to the ODK working directory. */
+static const char *
+get_work_root(odk_run_config_t *cfg)
+{
+    for ( size_t i = 0; i < cfg->n_bindings; i++ )
+        if ( strcmp(cfg->bindings[i].container_directory, "/work") == 0 )
+            return cfg->bindings[i].host_directory;
+
+    return NULL;
+}
+
+/*
+ * Makes the SSH configuration, keys, and known hosts of the user
+ * available to ssh within a Docker container, by binding ~/.ssh into
+ * the home directory of the ODK user. This requires the command to run
+ * as that user, with a passwd entry.
+ */
+static int
+setup_ssh(odk_run_config_t *cfg)
+{
+    const char *home;
+    char *ssh_dir;
+
+    if ( cfg->flags & ODK_FLAG_RUNASROOT ) {
+        warnx("SSH configuration not available when running as root");
+        return 0;
+    }
+
+    if ( ! (home = getenv("HOME")) )
+        return 0;
+
+    ssh_dir = mr_sprintf(&cfg->mr, "%s/.ssh", home);
+    if ( file_exists(ssh_dir) == -1 )
+        return 0;
+
+    cfg->flags &= ~ODK_FLAG_DIRECTUSER;
+
+    return odk_add_binding(cfg, ssh_dir, DOCKER_SSH_DIR, 0);
+}
+
+/**
+ * Sets up the distributed execution of a make command, if a pool of
+ * executors is configured.
+ *
+ * @param shims   The set of shims to use for the command.
+ * @param cfg     The ODK configuration.
+ * @param backend The backend that will run the command.
+ * @param command The command to run.
+ *
+ * @return The command to run instead (with the SHELL wrapper), which
+ *         is not owned by the caller; or the original command if
+ *         there is nothing to distribute; or NULL if an error occured
+ *         (check errno for details).
+ */
+char **
+odk_dispatch_setup(odk_shims_t *shims, odk_run_config_t *cfg, odk_backend_t *backend, char **command)
+{
+    const char *executors, *root;
+    char **wrapped, *spec, *item, *path;
+    size_t n = 2, i = 0;    /* SHELL=... NULL */
+    int native, remote = 0;
+
+    if ( ! command[0] || strcmp(command[0], "make") != 0
+            || ! (executors = get_cfg_var(cfg, "ODK_EXECUTORS")) || ! *executors
+            || ! (root = get_work_root(cfg)) )
+        return command;
+
+    native = strcmp(backend->info.name, "native") == 0;
+
+    /* Local executors must be visible from within the container, at
+     * the same path. */
+    spec = mr_strdup(NULL, executors);
+    for ( item = strtok(spec, " "); item; item = strtok(NULL, " ") ) {
+        if ( strncmp(item, "ssh://", 6) == 0 )
+            remote = 1;
+        if ( strncmp(item, "local:", 6) != 0 || native )
+            continue;
+
+        path = mr_strdup(&cfg->mr, item + 6);
+        if ( strchr(path, '#') )
+            *strchr(path, '#') = '\0';
+        if ( create_directory(path) == -1 || odk_add_binding(cfg, path, path, 0) == -1 )
+            return NULL;
+    }
+
+    if ( remote && strcmp(backend->info.name, "docker") == 0 && setup_ssh(cfg) == -1 )
+        return NULL;
+
+    if ( odk_shims_add(shims, "odkrun-dispatch", dispatch_script) == -1 )
+        return NULL;
+
+    odk_add_env_var(cfg, "ODKRUN_WORK_ROOT", native ? root : "/work", 0);
+    odk_add_env_var(cfg, "ODKRUN_IMAGE", cfg->image_name, 0);
+    odk_add_env_var(cfg, "ODKRUN_TAG", cfg->image_tag, 0);
+
+    for ( char **cursor = command; *cursor; cursor++ )
+        n += 1;
+
+    wrapped = mr_alloc(NULL, sizeof(char *) * n);
+    for ( char **cursor = command; *cursor; cursor++ )
+        wrapped[i++] = *cursor;
+    wrapped[i++] = mr_sprintf(NULL, "SHELL=%s/odkrun-dispatch", shims->container_directory);
+    wrapped[i] = NULL;
+
+    return wrapped;
+}
@@ -0,0 +1,432 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "fileprof.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_SYS_INOTIFY_H)
+#define ODK_FILE_PROFILE_SUPPORTED
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#endif
+
+#include <xmem.h>
+
+#include "util.h"
+
+/*
+ * File access profiling.
+ *
+ * We watch all the directories below the working directory with
+ * inotify, which (contrary to fanotify) does not require any special
+ * privilege and works with all backends, since the containers write
+ * to the host file system through bind mounts. inotify does not tell
+ * how many bytes are read or written, so the volumes are estimated
+ * from the size of each file when it is closed: a file that was read
+ * from (resp. written to) between its opening and its closing is
+ * assumed to have been read (resp. written) entirely. This is exact
+ * for the typical "read whole file/write whole file" pattern of most
+ * ODK tools.
+ */
+
+#if defined(ODK_FILE_PROFILE_SUPPORTED)
+
+#define HASH_SIZE   4096
+#define WATCH_MASK  (IN_OPEN | IN_ACCESS | IN_MODIFY | IN_CLOSE_WRITE | IN_CLOSE_NOWRITE | IN_CREATE | IN_MOVED_TO)
+
+/* Access figures for a single file. */
+typedef struct file_entry {
+    char               *path;       /* Relative to the root */
+    unsigned long       opens;
+    unsigned long       reads;
+    unsigned long       writes;
+    unsigned long long  bytes_read;
+    unsigned long long  bytes_written;
+    unsigned long       last_read;
+    unsigned long       last_write;
+    int                 accessed;
+    int                 modified;
+    struct file_entry  *next;
+} file_entry_t;
+
+/* Private state of the watching thread. */
+typedef struct profile_state {
+    int             fd;
+    int             stop_pipe[2];
+    pthread_t       thread;
+    char          **dirs;           /* Indexed by watch descriptor */
+    size_t          n_dirs;
+    file_entry_t   *files[HASH_SIZE];
+    size_t          n_files;
+    unsigned long   sequence;
+} profile_state_t;
+
+/* Adds a watch on a directory and all its subdirectories. */
+static void
+watch_tree(odk_file_profile_t *fp, const char *relpath)
+{
+    profile_state_t *ps = fp->priv;
+    char *path;
+    int wd;
+    DIR *dir;
+    struct dirent *entry;
+
+    xasprintf(&path, "%s%s%s", fp->root, *relpath ? "/" : "", relpath);
+
+    if ( (wd = inotify_add_watch(ps->fd, path, WATCH_MASK | IN_ONLYDIR)) != -1 ) {
+        if ( (size_t)wd >= ps->n_dirs ) {
+            size_t n = wd + 64;
+
+            ps->dirs = xrealloc(ps->dirs, sizeof(char *) * n);
+            memset(ps->dirs + ps->n_dirs, 0, sizeof(char *) * (n - ps->n_dirs));
+            ps->n_dirs = n;
+        }
+        if ( ! ps->dirs[wd] ) {
+            ps->dirs[wd] = xstrdup(relpath);
+            fp->n_watches += 1;
+        }
+
+        if ( (dir = opendir(path)) ) {
+            while ( (entry = readdir(dir)) ) {
+                char *child;
+                struct stat st;
+
+                if ( entry->d_name[0] == '.' )
+                    continue;   /* Also skips .git */
+
+                xasprintf(&child, "%s%s%s", relpath, *relpath ? "/" : "", entry->d_name);
+                if ( entry->d_type == DT_DIR || (entry->d_type == DT_UNKNOWN
+                            && fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0
+                            && S_ISDIR(st.st_mode)) )
+                    watch_tree(fp, child);
+                free(child);
+            }
+            closedir(dir);
+        }
+    }
+
+    free(path);
+}
+
+/* Gets the entry for the specified file, creating it if needed. */
+static file_entry_t *
+get_file_entry(profile_state_t *ps, const char *dir, const char *name)
+{
+    char *path;
+    unsigned h;
+    file_entry_t *entry;
+
+    xasprintf(&path, "%s%s%s", dir, *dir ? "/" : "", name);
+    h = hash_fnv1a(FNV1A_INIT, path, strlen(path)) % HASH_SIZE;
+
+    for ( entry = ps->files[h]; entry; entry = entry->next ) {
+        if ( strcmp(entry->path, path) == 0 ) {
+            free(path);
+            return entry;
+        }
+    }
+
+    entry = xmalloc(sizeof(file_entry_t));
+    memset(entry, 0, sizeof(file_entry_t));
+    entry->path = path;
+    entry->next = ps->files[h];
+    ps->files[h] = entry;
+    ps->n_files += 1;
+
+    return entry;
+}
+
+/* Gets the current size of a file. */
+static unsigned long long
+get_entry_size(odk_file_profile_t *fp, file_entry_t *entry)
+{
+    char *path;
+    struct stat st;
+    unsigned long long size = 0;
+
+    xasprintf(&path, "%s/%s", fp->root, entry->path);
+    if ( stat(path, &st) == 0 )
+        size = st.st_size;
+    free(path);
+
+    return size;
+}
+
+/* Processes all the events in a buffer. */
+static void
+process_events(odk_file_profile_t *fp, char *buffer, ssize_t len)
+{
+    profile_state_t *ps = fp->priv;
+    struct inotify_event *ev;
+    file_entry_t *entry;
+
+    for ( char *p = buffer; p < buffer + len; p += sizeof(struct inotify_event) + ev->len ) {
+        ev = (struct inotify_event *)p;
+
+        if ( ev->mask & IN_Q_OVERFLOW ) {
+            fp->overflow = 1;
+            continue;
+        }
+
+        if ( ev->wd < 0 || (size_t)ev->wd >= ps->n_dirs || ! ps->dirs[ev->wd] || ev->len == 0 )
+            continue;
+
+        if ( ev->mask & IN_ISDIR ) {
+            if ( (ev->mask & (IN_CREATE | IN_MOVED_TO)) && ev->name[0] != '.' ) {
+                char *child;
+
+                xasprintf(&child, "%s%s%s", ps->dirs[ev->wd], *ps->dirs[ev->wd] ? "/" : "", ev->name);
+                watch_tree(fp, child);
+                free(child);
+            }
+            continue;
+        }
+
+        entry = get_file_entry(ps, ps->dirs[ev->wd], ev->name);
+        if ( ev->mask & IN_OPEN )
+            entry->opens += 1;
+        if ( ev->mask & IN_ACCESS )
+            entry->accessed = 1;
+        if ( ev->mask & IN_MODIFY )
+            entry->modified = 1;
+        if ( (ev->mask & IN_CLOSE_NOWRITE) && entry->accessed ) {
+            entry->reads += 1;
+            entry->bytes_read += get_entry_size(fp, entry);
+            entry->last_read = ++ps->sequence;
+            entry->accessed = 0;
+        }
+        if ( (ev->mask & IN_CLOSE_WRITE) && entry->modified ) {
+            entry->writes += 1;
+            entry->bytes_written += get_entry_size(fp, entry);
+            entry->last_write = ++ps->sequence;
+            entry->modified = 0;
+        }
+    }
+}
+
+static void *
+profile_thread(void *arg)
+{
+    odk_file_profile_t *fp = arg;
+    profile_state_t *ps = fp->priv;
+    struct pollfd fds[2];
+    char buffer[65536] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    int stop = 0;
+
+    fds[0].fd = ps->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = ps->stop_pipe[0];
+    fds[1].events = POLLIN;
+
+    while ( ! stop ) {
+        if ( poll(fds, 2, -1) == -1 ) {
+            if ( errno == EINTR )
+                continue;
+            break;
+        }
+
+        /* When asked to stop, process the pending events first. */
+        stop = fds[1].revents != 0;
+
+        while ( (len = read(ps->fd, buffer, sizeof(buffer))) > 0 )
+            process_events(fp, buffer, len);
+    }
+
+    return NULL;
+}
+
+/* Sorts entries by decreasing total volume. */
+static int
+compare_entries(const void *a, const void *b)
+{
+    const file_entry_t *e1 = *(const file_entry_t **)a;
+    const file_entry_t *e2 = *(const file_entry_t **)b;
+    unsigned long long v1 = e1->bytes_read + e1->bytes_written;
+    unsigned long long v2 = e2->bytes_read + e2->bytes_written;
+
+    return v1 < v2 ? 1 : v1 > v2 ? -1 : strcmp(e1->path, e2->path);
+}
+
+/* Prints the profile, ranked by I/O volume. */
+static void
+print_report(odk_file_profile_t *fp, FILE *out)
+{
+    profile_state_t *ps = fp->priv;
+    file_entry_t **entries, *entry;
+    size_t n = 0, unread = 0;
+    unsigned long long total_read = 0, total_written = 0;
+
+    entries = xmalloc(sizeof(file_entry_t *) * (ps->n_files + 1));
+    for ( unsigned i = 0; i < HASH_SIZE; i++ ) {
+        for ( entry = ps->files[i]; entry; entry = entry->next ) {
+            if ( entry->reads + entry->writes == 0 )
+                continue;
+            entries[n++] = entry;
+            total_read += entry->bytes_read;
+            total_written += entry->bytes_written;
+            if ( entry->last_write > entry->last_read )
+                unread += 1;
+        }
+    }
+    qsort(entries, n, sizeof(file_entry_t *), compare_entries);
+
+    fprintf(out, "### FILE ACCESS PROFILE ###\n");
+    fprintf(out, "%10s %10s %6s %6s %6s  %s\n", "Read (MB)", "Written", "Opens", "Reads", "Writes", "File");
+    for ( size_t i = 0; i < n && i < ODK_FILE_PROFILE_MAX_ENTRIES; i++ ) {
+        entry = entries[i];
+        fprintf(out, "%10.1f %10.1f %6lu %6lu %6lu  %s%s\n",
+                entry->bytes_read / 1048576.0, entry->bytes_written / 1048576.0,
+                entry->opens, entry->reads, entry->writes, entry->path,
+                entry->last_write > entry->last_read ? " (not read after last write)" : "");
+    }
+    if ( n > ODK_FILE_PROFILE_MAX_ENTRIES )
+        fprintf(out, "... and %zu more files\n", n - ODK_FILE_PROFILE_MAX_ENTRIES);
+    fprintf(out, "Total: %.1f MB read, %.1f MB written, %zu files accessed, "
+            "%zu files not read after being written\n",
+            total_read / 1048576.0, total_written / 1048576.0, n, unread);
+    if ( fp->overflow )
+        fprintf(out, "Some events were lost, figures are incomplete\n");
+
+    free(entries);
+}
+
+#endif /* ODK_FILE_PROFILE_SUPPORTED */
+
+/**
+ * Starts recording accesses to the files below a directory. This
+ * function returns immediately, while accesses are recorded in the
+ * background.
+ *
+ * @param fp        The profile object to initialise.
+ * @param directory The directory to watch.
+ *
+ * @return 0 if successful, or -1 if an error occured (check errno for
+ *         details).
+ */
+int
+odk_file_profile_start(odk_file_profile_t *fp, const char *directory)
+{
+    memset(fp, 0, sizeof(odk_file_profile_t));
+
+#if defined(ODK_FILE_PROFILE_SUPPORTED)
+    profile_state_t *ps;
+
+    ps = xmalloc(sizeof(profile_state_t));
+    memset(ps, 0, sizeof(profile_state_t));
+    if ( (ps->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1 ) {
+        free(ps);
+        return -1;
+    }
+    if ( pipe(ps->stop_pipe) == -1 ) {
+        close(ps->fd);
+        free(ps);
+        return -1;
+    }
+
+    fp->priv = ps;
+    fp->root = xstrdup(directory);
+    watch_tree(fp, "");
+
+    if ( fp->n_watches == 0 || pthread_create(&ps->thread, NULL, profile_thread, fp) != 0 ) {
+        fp->n_watches = 0;
+        odk_file_profile_finish(fp, NULL);
+        return -1;
+    }
+
+    return 0;
+#else
+    (void) directory;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * Stops recording file accesses, prints a report, and releases all
+ * associated resources.
+ *
+ * @param fp  The profile object.
+ * @param out Where to print the report; may be NULL to print nothing.
+ */
+void
+odk_file_profile_finish(odk_file_profile_t *fp, FILE *out)
+{
+#if defined(ODK_FILE_PROFILE_SUPPORTED)
+    profile_state_t *ps = fp->priv;
+
+    if ( ps ) {
+        if ( fp->n_watches > 0 ) {
+            /* Closing the pipe wakes up the thread. */
+            close(ps->stop_pipe[1]);
+            ps->stop_pipe[1] = -1;
+            pthread_join(ps->thread, NULL);
+            if ( out )
+                print_report(fp, out);
+        }
+
+        close(ps->fd);
+        close(ps->stop_pipe[0]);
+        if ( ps->stop_pipe[1] != -1 )
+            close(ps->stop_pipe[1]);
+        for ( size_t i = 0; i < ps->n_dirs; i++ )
+            free(ps->dirs[i]);
+        free(ps->dirs);
+        for ( unsigned i = 0; i < HASH_SIZE; i++ ) {
+            file_entry_t *entry, *next;
+
+            for ( entry = ps->files[i]; entry; entry = next ) {
+                next = entry->next;
+                free(entry->path);
+                free(entry);
+            }
+        }
+        free(ps);
+        fp->priv = NULL;
+    }
+#else
+    (void) out;
+#endif
+
+    free(fp->root);
+    fp->root = NULL;
+}
@@ -0,0 +1,311 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#if !defined(ODK_RUNNER_WINDOWS)
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#endif
+
+#include <xmem.h>
+#include <sbuffer.h>
+
+/*
+ * Cumulative run metrics.
+ *
+ * The metrics are stored in a text file in the Prometheus exposition
+ * format, as expected by the "textfile" collector of node_exporter.
+ * Since odkrun is not a long-running process, the file itself is the
+ * only place where the metrics are stored: on each update, we read all
+ * samples from the existing file, update those that concern the
+ * current invocation, and write the whole file again (under a
+ * temporary name, then renamed so that the collector never sees a
+ * partially written file).
+ */
+
+#define METRICS_COUNTER     1
+#define METRICS_GAUGE       2
+#define METRICS_HISTOGRAM   3
+
+static struct {
+    const char *name;
+    int         type;
+    const char *help;
+} families[] = {
+    { "odkrun_runs_total",            METRICS_COUNTER,   "Number of ODK commands run." },
+    { "odkrun_run_failures_total",    METRICS_COUNTER,   "Number of ODK commands that exited with a non-zero status." },
+    { "odkrun_oom_kills_total",       METRICS_COUNTER,   "Number of ODK commands that were killed, most likely for lack of memory." },
+    { "odkrun_dedup_hits_total",      METRICS_COUNTER,   "Number of ODK commands served by attaching to an identical running command." },
+    { "odkrun_run_duration_seconds",  METRICS_HISTOGRAM, "Duration of ODK commands." },
+    { "odkrun_java_max_heap_bytes",   METRICS_GAUGE,     "Maximal Java heap size used in the last ODK command." },
+    { NULL, 0, NULL }
+};
+
+static double duration_buckets[] = { 10, 30, 60, 300, 600, 1800, 3600, 7200, 14400, -1 };
+
+typedef struct metric_sample {
+    char   *key;        /* Metric name and labels */
+    double  value;
+} metric_sample_t;
+
+typedef struct metric_set {
+    metric_sample_t *samples;
+    size_t           count;
+} metric_set_t;
+
+/* Gets the sample with the given key, creating it if needed. */
+static metric_sample_t *
+get_sample(metric_set_t *set, const char *key)
+{
+    for ( size_t i = 0; i < set->count; i++ )
+        if ( strcmp(set->samples[i].key, key) == 0 )
+            return &(set->samples[i]);
+
+    if ( set->count % 20 == 0 )
+        set->samples = xrealloc(set->samples, sizeof(metric_sample_t) * (set->count + 20));
+
+    set->samples[set->count].key = xstrdup(key);
+    set->samples[set->count].value = 0;
+
+    return &(set->samples[set->count++]);
+}
+
+/* Adds a value to a sample, or sets it if replace is non-zero. */
+static void
+update_sample(metric_set_t *set, double value, int replace, const char *fmt, ...)
+{
+    va_list ap;
+    char *key;
+    metric_sample_t *sample;
+
+    va_start(ap, fmt);
+    xvasprintf(&key, fmt, ap);
+    va_end(ap);
+
+    sample = get_sample(set, key);
+    if ( replace )
+        sample->value = value;
+    else
+        sample->value += value;
+
+    free(key);
+}
+
+/* Reads all samples from an existing metrics file. */
+static void
+read_samples(metric_set_t *set, const char *path)
+{
+    FILE *f;
+    char *line = NULL, *space;
+    size_t n = 0;
+    ssize_t len;
+
+    if ( ! (f = fopen(path, "r")) )
+        return;
+
+    while ( (len = getline(&line, &n, f)) != -1 ) {
+        if ( len > 0 && line[len - 1] == '\n' )
+            line[--len] = '\0';
+
+        if ( len == 0 || line[0] == '#' || ! (space = strrchr(line, ' ')) )
+            continue;
+
+        *space++ = '\0';
+        get_sample(set, line)->value = strtod(space, NULL);
+    }
+
+    free(line);
+    fclose(f);
+}
+
+/* Writes all samples, grouped by family, to the specified file. */
+static int
+write_samples(metric_set_t *set, const char *path)
+{
+    FILE *f;
+
+    if ( ! (f = fopen(path, "w")) )
+        return -1;
+
+    for ( int i = 0; families[i].name; i++ ) {
+        size_t len = strlen(families[i].name);
+
+        fprintf(f, "# HELP %s %s\n", families[i].name, families[i].help);
+        fprintf(f, "# TYPE %s %s\n", families[i].name,
+                families[i].type == METRICS_COUNTER ? "counter" :
+                families[i].type == METRICS_GAUGE ? "gauge" : "histogram");
+
+        for ( size_t j = 0; j < set->count; j++ ) {
+            const char *key = set->samples[j].key;
+
+            if ( strncmp(key, families[i].name, len) != 0 )
+                continue;
+
+            key += len;
+            if ( *key == '{' || (families[i].type == METRICS_HISTOGRAM &&
+                        (strncmp(key, "_bucket{", 8) == 0 ||
+                         strncmp(key, "_sum{", 5) == 0 ||
+                         strncmp(key, "_count{", 7) == 0)) )
+                fprintf(f, "%s %.15g\n", set->samples[j].key, set->samples[j].value);
+        }
+    }
+
+    if ( fclose(f) == EOF )
+        return -1;
+
+    return 0;
+}
+
+/* Appends a label value, escaped as required by the format. */
+static void
+add_label_value(string_buffer_t *sb, const char *value)
+{
+    for ( ; *value; value++ ) {
+        if ( *value == '\\' || *value == '"' )
+            sb_addc(sb, '\\');
+        if ( *value == '\n' )
+            sb_add(sb, "\\n");
+        else
+            sb_addc(sb, *value);
+    }
+}
+
+/* Gets the name of the repository (the directory bound to /work). */
+static const char *
+get_repository_name(odk_run_config_t *cfg)
+{
+    const char *name = "";
+
+    for ( size_t i = 0; i < cfg->n_bindings; i++ ) {
+        if ( strcmp(cfg->bindings[i].container_directory, "/work") == 0 ) {
+            const char *slash;
+
+            name = cfg->bindings[i].host_directory;
+            if ( (slash = strrchr(name, '/')) && *(slash + 1) != '\0' )
+                name = slash + 1;
+        }
+    }
+
+    return name;
+}
+
+/**
+ * Adds the outcome of an invocation to a metrics file.
+ *
+ * @param path The metrics file to update. It is created if it does not
+ *             exist.
+ * @param cfg  The ODK configuration used for the invocation.
+ * @param rec  The outcome of the invocation.
+ *
+ * @return 0 if successful, or -1 if an error occured (check errno for
+ *         details).
+ */
+int
+odk_metrics_update(const char *path, odk_run_config_t *cfg, odk_run_record_t *rec)
+{
+    metric_set_t set = { NULL, 0 };
+    string_buffer_t sb;
+    char *labels, *tmp_path;
+    double heap;
+    int ret;
+#if !defined(ODK_RUNNER_WINDOWS)
+    char *lock_path;
+    int lock_fd;
+
+    /* Serialise updates from concurrent invocations. */
+    xasprintf(&lock_path, "%s.lock", path);
+    if ( (lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) != -1 )
+        flock(lock_fd, LOCK_EX);
+    free(lock_path);
+#endif
+
+    read_samples(&set, path);
+
+    sb_init(&sb, 128);
+    sb_add(&sb, "repository=\"");
+    add_label_value(&sb, get_repository_name(cfg));
+    sb_add(&sb, "\",backend=\"");
+    add_label_value(&sb, rec->backend ? rec->backend : "");
+    sb_add(&sb, "\",image_tag=\"");
+    add_label_value(&sb, cfg->image_tag);
+    sb_addc(&sb, '"');
+    labels = sb_get_copy(&sb);
+    free(sb.buffer);
+
+    update_sample(&set, 1, 0, "odkrun_runs_total{%s}", labels);
+    update_sample(&set, rec->status != 0, 0, "odkrun_run_failures_total{%s}", labels);
+    update_sample(&set, rec->killed != 0, 0, "odkrun_oom_kills_total{%s}", labels);
+    update_sample(&set, rec->attached != 0, 0, "odkrun_dedup_hits_total{%s}", labels);
+
+    for ( int i = 0; duration_buckets[i] > 0; i++ )
+        update_sample(&set, rec->duration <= duration_buckets[i], 0,
+                      "odkrun_run_duration_seconds_bucket{%s,le=\"%g\"}", labels, duration_buckets[i]);
+    update_sample(&set, 1, 0, "odkrun_run_duration_seconds_bucket{%s,le=\"+Inf\"}", labels);
+    update_sample(&set, rec->duration, 0, "odkrun_run_duration_seconds_sum{%s}", labels);
+    update_sample(&set, 1, 0, "odkrun_run_duration_seconds_count{%s}", labels);
+
+    if ( (heap = odk_get_java_max_heap(cfg)) > 0 )
+        update_sample(&set, heap, 1, "odkrun_java_max_heap_bytes{%s}", labels);
+
+    xasprintf(&tmp_path, "%s.tmp", path);
+    if ( (ret = write_samples(&set, tmp_path)) == 0 ) {
+#if defined(ODK_RUNNER_WINDOWS)
+        /* rename() does not replace an existing file on Windows. */
+        remove(path);
+#endif
+        ret = rename(tmp_path, path);
+    }
+    if ( ret == -1 )
+        remove(tmp_path);
+    free(tmp_path);
+
+    for ( size_t i = 0; i < set.count; i++ )
+        free(set.samples[i].key);
+    free(set.samples);
+    free(labels);
+
+#if !defined(ODK_RUNNER_WINDOWS)
+    if ( lock_fd != -1 )
+        close(lock_fd);
+#endif
+
+    return ret;
+}
@@ -82,7 +82,7 @@
  *         small to contain the full path. May return -1 if we were
  *         not able to obtain the user's home directory.
  */
-static int
+int
 get_oaklib_cache_directory(char *buffer, size_t len)
 {
     int ret = - 1;
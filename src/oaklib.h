@@ -40,6 +40,9 @@
 extern "C" {
 #endif
 
+int
+get_oaklib_cache_directory(char *, size_t);
+
 int
 share_oaklib_cache(odk_run_config_t *, const char *);
 
@@ -0,0 +1,242 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "oakserver.h"
+
+/*
+ * Forkserver for OAK commands.
+ *
+ * Most of the time spent by a 'runoak' command that works on a small
+ * ontology is in fact spent importing Python modules, which ODK
+ * workflows pay again for every single call. When the server is
+ * enabled, a 'runoak' shim starts, on its first invocation, a Python
+ * process (using the same interpreter as the real 'runoak') that
+ * imports OAK once and listens on a Unix socket in the shims
+ * directory. Each 'runoak' call then sends its arguments, working
+ * directory, environment and standard file descriptors to that server,
+ * which forks a child to run the command with everything already
+ * loaded, and reports its exit status back. Since the child sees the
+ * same environment and filesystem as the caller, the OAK cache set up
+ * by share_oaklib_cache() is used as usual.
+ *
+ * The server exits when it has been idle for a while, or when its
+ * socket is removed along with the shims. If it cannot be started for
+ * any reason, the real 'runoak' is used.
+ */
+
+static const char *runoak_shim = "\
+shims=$(cd \"$(dirname \"$0\")\" && pwd)\n\
+PATH=$(printf ':%s:' \"$PATH\" | sed \"s|:$shims:|:|g; s|^:||; s|:$||\")\n\
+export PATH\n\
+real=$(command -v runoak) || exec runoak \"$@\"\n\
+python=$(sed -n '1s|^#! *||p' \"$real\")\n\
+case $python in\n\
+*python*) [ ${#shims} -lt 90 ] && exec $python \"$shims/odkrun-oak-client\" \"$@\" ;;\n\
+esac\n\
+exec \"$real\" \"$@\"\n\
+";
+
+static const char *client_script = "\
+#!/usr/bin/env python3\n\
+import array, json, os, signal, socket, struct, sys, time\n\
+\n\
+here = os.path.dirname(os.path.abspath(__file__))\n\
+sock_path = os.path.join(here, 'oak-server.sock')\n\
+\n\
+\n\
+def connect():\n\
+    s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)\n\
+    s.connect(sock_path)\n\
+    return s\n\
+\n\
+\n\
+def start_server():\n\
+    pid = os.fork()\n\
+    if pid == 0:\n\
+        os.setsid()\n\
+        fd = os.open(os.devnull, os.O_RDWR)\n\
+        for i in range(3):\n\
+            os.dup2(fd, i)\n\
+        os.execv(sys.executable, [sys.executable, os.path.join(here, 'odkrun-oak-server'), sock_path])\n\
+    while True:\n\
+        time.sleep(0.1)\n\
+        try:\n\
+            return connect()\n\
+        except OSError:\n\
+            if os.waitpid(pid, os.WNOHANG)[0] != 0:\n\
+                return connect()\n\
+\n\
+\n\
+def recv_exact(s, n):\n\
+    data = b''\n\
+    while len(data) < n:\n\
+        chunk = s.recv(n - len(data))\n\
+        if not chunk:\n\
+            raise EOFError\n\
+        data += chunk\n\
+    return data\n\
+\n\
+\n\
+try:\n\
+    try:\n\
+        s = connect()\n\
+    except OSError:\n\
+        s = start_server()\n\
+except OSError:\n\
+    os.execvp('runoak', ['runoak'] + sys.argv[1:])\n\
+\n\
+request = json.dumps({'argv': sys.argv[1:], 'cwd': os.getcwd(), 'env': dict(os.environ)}).encode()\n\
+s.sendmsg([struct.pack('!I', len(request)) + request],\n\
+          [(socket.SOL_SOCKET, socket.SCM_RIGHTS, array.array('i', [0, 1, 2]))])\n\
+try:\n\
+    child = struct.unpack('!i', recv_exact(s, 4))[0]\n\
+    for sig in (signal.SIGINT, signal.SIGTERM, signal.SIGHUP):\n\
+        signal.signal(sig, lambda n, f: os.kill(child, n))\n\
+    sys.exit(struct.unpack('!i', recv_exact(s, 4))[0])\n\
+except EOFError:\n\
+    sys.exit(1)\n\
+";
+
+static const char *server_script = "\
+#!/usr/bin/env python3\n\
+import array, io, json, os, signal, socket, struct, sys, time, traceback\n\
+\n\
+import oaklib.cli\n\
+\n\
+IDLE_TIMEOUT = 600\n\
+sock_path = sys.argv[1]\n\
+\n\
+\n\
+def recv_exact(s, n):\n\
+    data = b''\n\
+    while len(data) < n:\n\
+        chunk = s.recv(n - len(data))\n\
+        if not chunk:\n\
+            raise EOFError\n\
+        data += chunk\n\
+    return data\n\
+\n\
+\n\
+def serve(conn):\n\
+    fds = array.array('i')\n\
+    msg, ancdata, flags, addr = conn.recvmsg(4, socket.CMSG_SPACE(3 * fds.itemsize))\n\
+    for level, type, data in ancdata:\n\
+        if level == socket.SOL_SOCKET and type == socket.SCM_RIGHTS:\n\
+            fds.frombytes(data[:len(data) - (len(data) % fds.itemsize)])\n\
+    if len(fds) != 3:\n\
+        return\n\
+    request = json.loads(recv_exact(conn, struct.unpack('!I', msg + recv_exact(conn, 4 - len(msg)))[0]))\n\
+\n\
+    pid = os.fork()\n\
+    if pid != 0:\n\
+        for fd in fds:\n\
+            os.close(fd)\n\
+        return\n\
+\n\
+    server.close()\n\
+    signal.signal(signal.SIGCHLD, signal.SIG_DFL)\n\
+    for i, fd in enumerate(fds):\n\
+        os.dup2(fd, i)\n\
+        os.close(fd)\n\
+    sys.stdin = io.TextIOWrapper(io.FileIO(0, 'r', closefd=False))\n\
+    sys.stdout = io.TextIOWrapper(io.FileIO(1, 'w', closefd=False), line_buffering=os.isatty(1))\n\
+    sys.stderr = io.TextIOWrapper(io.FileIO(2, 'w', closefd=False), line_buffering=True)\n\
+    code = 1\n\
+    try:\n\
+        conn.sendall(struct.pack('!i', os.getpid()))\n\
+        os.chdir(request['cwd'])\n\
+        os.environ.clear()\n\
+        os.environ.update(request['env'])\n\
+        sys.argv = ['runoak'] + request['argv']\n\
+        oaklib.cli.main(args=request['argv'], prog_name='runoak')\n\
+        code = 0\n\
+    except SystemExit as e:\n\
+        code = e.code if isinstance(e.code, int) else 0 if e.code is None else 1\n\
+    except BaseException:\n\
+        traceback.print_exc()\n\
+    try:\n\
+        sys.stdout.flush()\n\
+        sys.stderr.flush()\n\
+        conn.sendall(struct.pack('!i', code))\n\
+    finally:\n\
+        os._exit(code)\n\
+\n\
+\n\
+server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)\n\
+try:\n\
+    server.bind(sock_path)\n\
+except OSError:\n\
+    # Remove the socket of a dead server, but not that of a live one\n\
+    try:\n\
+        socket.socket(socket.AF_UNIX, socket.SOCK_STREAM).connect(sock_path)\n\
+        sys.exit(0)\n\
+    except OSError:\n\
+        os.unlink(sock_path)\n\
+        server.bind(sock_path)\n\
+server.listen(64)\n\
+server.settimeout(10)\n\
+signal.signal(signal.SIGCHLD, signal.SIG_IGN)\n\
+last = time.monotonic()\n\
+while os.path.exists(sock_path) and time.monotonic() - last < IDLE_TIMEOUT:\n\
+    try:\n\
+        conn, addr = server.accept()\n\
+    except socket.timeout:\n\
+        continue\n\
+    conn.settimeout(None)\n\
+    try:\n\
+        serve(conn)\n\
+    except (OSError, EOFError, ValueError):\n\
+        pass\n\
+    conn.close()\n\
+    last = time.monotonic()\n\
+";
+
+/**
+ * Enables the OAK server for the next command.
+ *
+ * @param shims The set of shims to use for the command.
+ *
+ * @return 0 if successful, or -1 if an error occured (check errno for
+ *         details).
+ */
+int
+odk_oak_server_enable(odk_shims_t *shims)
+{
+    if ( odk_shims_add(shims, "odkrun-oak-client", client_script) == -1
+            || odk_shims_add(shims, "odkrun-oak-server", server_script) == -1
+            || odk_shims_add(shims, "runoak", runoak_shim) == -1 )
+        return -1;
+
+    return 0;
+}
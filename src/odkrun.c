@@ -44,12 +44,27 @@
 
 #include "runner.h"
 #include "util.h"
+#include "procutil.h"
 #include "backend-docker.h"
 #include "backend-singularity.h"
 #include "backend-native.h"
+#include "backend-kubernetes.h"
 #include "oaklib.h"
 #include "owlapi.h"
 #include "runconf.h"
+#include "runlock.h"
+#include "prefetch.h"
+#include "metrics.h"
+#include "shims.h"
+#include "sparql.h"
+#include "oakserver.h"
+#include "fileprof.h"
+#include "usage.h"
+#include "cache.h"
+#include "checkpoint.h"
+#include "toolchain.h"
+#include "tune.h"
+#include "dispatch.h"
 
 
 /* Help and information about the program. */
@@ -58,7 +73,9 @@ static void
 usage(int status)
 {
     puts("\
-Usage: odkrun [options] [seed|COMMAND...]\n\
+Usage: odkrun [options] [seed [--batch DIR]|tune [--] COMMAND...|COMMAND...]\n\
+   or: odkrun [options] native install [--tag TAG]\n\
+   or: odkrun [options] cache stats|gc [--dry-run] [--prune-images]\n\
 Start a ODK container.\n");
 
     puts("General options:\n\
@@ -74,14 +91,49 @@ Start a ODK container.\n");
                         'latest' tag.\n\
     -l, --lite          Use the 'obolibrary/odklite' image. This is\n\
                         equivalent to '--image obolibrary/odklite'.\n\
+        --pull          Fetch the latest version of the image in the\n\
+                        background while preparing the container.\n\
 ");
 
     puts("Backend options:\n\
     -s, --singulary     Run the container with Singularity rather\n\
                         than Docker (experimental).\n\
     -n, --native        Run in the native system, not in a container\n\
-                        (VERY experimental).\n\
+                        (VERY experimental). Use 'native install' to\n\
+                        extract the tools from the image first.\n\
+        --kubernetes    Run the command as a Kubernetes Job, with\n\
+                        kubectl (experimental).\n\
         --root          Run as a superuser within the container.\n\
+        --direct-user   Start the container directly as the current\n\
+                        user, instead of having the image create a\n\
+                        user account at startup (Docker only).\n\
+        --priority background|normal|high\n\
+                        Set the CPU, I/O and memory priority of the\n\
+                        command. Background commands yield to other\n\
+                        processes and are killed first when memory is\n\
+                        short.\n\
+        --network host|none|bridge\n\
+                        Set the network mode of the container. The\n\
+                        default is to use the backend's default mode,\n\
+                        unless the targets of a 'make' command have\n\
+                        been declared offline or network-heavy in\n\
+                        run.sh.conf.\n\
+        --dedup         Attach to an identical 'make' command already\n\
+                        running in the same repository, instead of\n\
+                        starting a new container.\n\
+        --executors LIST\n\
+                        Run the ROBOT commands of 'make' recipes on\n\
+                        the specified executors when possible.\n\
+        --sparql-store  Answer simple 'robot query' and 'robot verify'\n\
+                        commands from a persistent triple store, so\n\
+                        that ontology files are not parsed again for\n\
+                        every query (experimental).\n\
+        --oak-server    Run 'runoak' commands from a server where OAK\n\
+                        is already loaded, so that its startup time is\n\
+                        only paid once (experimental).\n\
+        --checkpoint    Run the command in a container restored from a\n\
+                        checkpoint of a warmed-up container, with CRIU\n\
+                        (Docker only, experimental).\n\
 ");
 
     puts("Passing settings and data to the container:\n\
@@ -102,6 +154,28 @@ Start a ODK container.\n");
                         Share a OAK cache directory with the container.\n\
     -K, --oak-user-cache\n\
                         Equivalent to '--oak-cache=user'.\n\
+        --prefetch GLOB Start reading the files matching GLOB in the\n\
+                        background while the container is starting.\n\
+                        May be used several times.\n\
+");
+
+    puts("Monitoring options:\n\
+        --profile-files Record accesses to the files of the working\n\
+                        directory and print a report of the files\n\
+                        with the largest I/O volume (Linux only).\n\
+        --record-usage FILE\n\
+                        Record the memory, CPU, and I/O used by the\n\
+                        command over time into FILE (CSV), along with\n\
+                        the program running at each moment, and plot\n\
+                        them into a SVG file (Linux only).\n\
+        --usage-interval MS\n\
+                        Take a sample every MS milliseconds when\n\
+                        recording resource usage (default 1000).\n\
+        --metrics-textfile PATH\n\
+                        Add the outcome of the command (status,\n\
+                        duration, Java heap size) to the cumulative\n\
+                        metrics in PATH, in the format expected by the\n\
+                        textfile collector of node_exporter.\n\
 ");
 
     printf("Report bugs to <%s>.\n", PACKAGE_BUGREPORT);
@@ -225,13 +299,32 @@ set_git_user(odk_run_config_t *cfg)
 {
     char *git_user = NULL, *git_email = NULL;
 
-    if ( ! (git_user = getenv("GIT_AUTHOR_NAME")) )
-        if ( (git_user = read_line_from_pipe("git config --get user.name")) )
-            mr_register(NULL, git_user, 0);
+    git_user = getenv("GIT_AUTHOR_NAME");
+    git_email = getenv("GIT_AUTHOR_EMAIL");
+
+    if ( ! git_user || ! git_email ) {
+        FILE *p;
+
+        /* Get both values with a single call to git. */
+        if ( (p = popen("git config --get-regexp \"^user\\.(name|email)$\"", "r")) ) {
+            char *line = NULL;
+            size_t n = 0;
+            ssize_t len;
 
-    if ( ! (git_email = getenv("GIT_AUTHOR_EMAIL")) )
-        if ( (git_email = read_line_from_pipe("git config --get user.email")) )
-            mr_register(NULL, git_email, 0);
+            while ( (len = getline(&line, &n, p)) != -1 ) {
+                if ( len > 0 && line[len - 1] == '\n' )
+                    line[--len] = '\0';
+
+                if ( ! git_user && strncmp(line, "user.name ", 10) == 0 )
+                    git_user = mr_strdup(NULL, line + 10);
+                else if ( ! git_email && strncmp(line, "user.email ", 11) == 0 )
+                    git_email = mr_strdup(NULL, line + 11);
+            }
+
+            free(line);
+            pclose(p);
+        }
+    }
 
     if ( git_user ) {
         odk_add_env_var(cfg, "GIT_AUTHOR_NAME", git_user, 0);
@@ -244,6 +337,78 @@ set_git_user(odk_run_config_t *cfg)
     }
 }
 
+/*
+ * Shell script to seed several repositories in parallel within a single
+ * container. Expects the directory containing the seeding configuration
+ * files as its first argument and the maximal number of parallel seeds
+ * as its second argument; all remaining arguments are passed to every
+ * invocation of 'odk.py seed'.
+ */
+static const char *seed_batch_script = "\
+dir=$1; jobs=$2; shift 2\n\
+odk=$(command -v odk.py || echo /tools/odk.py)\n\
+summary=$(mktemp)\n\
+export dir odk summary\n\
+start=$(date +%s)\n\
+ls \"$dir\" | grep -E '\\.ya?ml$' | xargs -P \"$jobs\" -I CONFIG sh -c '\n\
+  c=$1; shift\n\
+  s=$(date +%s%N)\n\
+  \"$odk\" seed -C \"$dir/$c\" \"$@\" > \"$dir/$c.log\" 2>&1\n\
+  rc=$?\n\
+  e=$(date +%s%N)\n\
+  printf \"%-40s %4d %8d.%03d s\\n\" \"$c\" $rc $(((e-s)/1000000000)) $(((e-s)/1000000%1000)) >> \"$summary\"\n\
+' seed CONFIG \"$@\"\n\
+end=$(date +%s)\n\
+printf '### SEED BATCH SUMMARY ###\\n%-40s %4s %14s\\n' Configuration Exit Time\n\
+sort \"$summary\"\n\
+total=$(wc -l < \"$summary\")\n\
+failed=$(awk '$2 != 0' \"$summary\" | wc -l)\n\
+rm -f \"$summary\"\n\
+echo \"$total repositories seeded in $((end-start)) s, $failed failed (see $dir/*.log)\"\n\
+[ $failed -eq 0 ]\n\
+";
+
+/* Prepares the command to seed all the repositories described by the
+ * configuration files in the specified directory. */
+static char **
+make_seed_batch_command(odk_run_config_t *cfg, odk_backend_t *backend, const char *dir, char **args)
+{
+    char **command, **cursor, *container_dir;
+    size_t n = 7, i = 0;     /* sh -c script $0 dir jobs ... NULL */
+
+    if ( file_exists(dir) == -1 )
+        err(EXIT_FAILURE, "Cannot use batch directory '%s'", dir);
+
+    if ( strcmp(backend->info.name, "native") == 0 )
+        container_dir = mr_register(NULL, realpath(dir, NULL), 0);
+    else {
+        container_dir = "/seed-batch";
+        if ( odk_add_binding(cfg, dir, container_dir, 0) == -1 )
+            err(EXIT_FAILURE, "Cannot bind directory '%s'", dir);
+    }
+
+    for ( cursor = args; *cursor; cursor++ )
+        n += 1;
+
+    command = mr_alloc(NULL, sizeof(char *) * n);
+    command[i++] = "sh";
+    command[i++] = "-c";
+    command[i++] = (char *)seed_batch_script;
+    command[i++] = "odkrun-seed-batch";
+    command[i++] = container_dir;
+    command[i++] = mr_sprintf(NULL, "%u", backend->info.n_cpus > 0 ? backend->info.n_cpus : 1);
+    for ( cursor = args; *cursor; cursor++ )
+        command[i++] = *cursor;
+    command[i] = NULL;
+
+    /* The script calls odk.py seed itself, so the backend must not
+     * add it in front of the command; we are still in seed mode for
+     * everything else. */
+    cfg->flags |= ODK_FLAG_SEEDBATCH;
+
+    return command;
+}
+
 /* Checks whether the specified directory is a ODK repository. */
 static int
 is_odk_repository(const char *directory)
@@ -283,6 +448,63 @@ set_work_directory(odk_run_config_t *cfg)
         err(EXIT_FAILURE, "Cannot bind directory '%s'", cwd);
 }
 
+/* Gets the host directory bound to the ODK working directory. */
+static const char *
+get_work_directory(odk_run_config_t *cfg)
+{
+    for ( size_t i = 0; i < cfg->n_bindings; i++ )
+        if ( strcmp(cfg->bindings[i].container_directory, "/work") == 0 )
+            return cfg->bindings[i].host_directory;
+
+    return ".";
+}
+
+/* Runs the command with the backend, from a checkpoint if requested. */
+static int
+run_command(odk_backend_t *backend, odk_run_config_t *cfg, char **command)
+{
+    if ( (cfg->flags & ODK_FLAG_CHECKPOINT) && (cfg->flags & ODK_FLAG_INODKREPO)
+            && (cfg->flags & ODK_FLAG_SEEDMODE) == 0 ) {
+        if ( strcmp(backend->info.name, "docker") == 0 )
+            return odk_checkpoint_run(cfg, backend, command);
+        warnx("Checkpoints are only supported with the Docker backend");
+    }
+
+    return backend->run(backend, cfg, command);
+}
+
+/* Records in the metrics file, if any, an invocation that failed
+ * before the command could be run. */
+static void
+record_failure(const char *metrics_file, odk_run_config_t *cfg, odk_backend_t *backend)
+{
+    odk_run_record_t record = { 0 };
+    int saved_errno = errno;
+
+    if ( metrics_file ) {
+        record.backend = backend->info.name;
+        record.status = EXIT_FAILURE;
+        if ( odk_metrics_update(metrics_file, cfg, &record) == -1 )
+            warn("Cannot update metrics file %s", metrics_file);
+    }
+    errno = saved_errno;
+}
+
+/* Starts recording the resources used by the command. */
+static void
+start_usage_recorder(odk_usage_recorder_t *usage, odk_run_config_t *cfg, odk_backend_t *backend,
+                     const char *filename, unsigned long interval)
+{
+    int docker = strcmp(backend->info.name, "docker") == 0;
+
+    if ( strcmp(backend->info.name, "kubernetes") == 0 )
+        warnx("Cannot record resource usage with the %s backend", backend->info.name);
+    else if ( odk_usage_recorder_start(usage, filename, docker, interval) == -1 )
+        warn("Cannot record resource usage");
+    else
+        cfg->container_id_file = usage->container_id_file;
+}
+
 /* Pass proxy informations to the container. */
 static char *
 get_host_and_port(const char *str, char **port)
@@ -393,17 +615,64 @@ set_max_java_mem(odk_run_config_t *cfg, long total_memory, const char *requested
         odk_add_java_opt(cfg, mr_sprintf(NULL, "-Xmx%lu%c", amount, unit), 0);
 }
 
+/* Prints the resource usage figures of the last command. */
+static void
+print_run_stats(odk_backend_t *backend)
+{
+    odk_run_stats_t stats;
+
+    if ( backend->stats(backend, &stats) == -1 )
+        return;
+
+    fprintf(stderr, "### RUNNER STATS ###\n");
+    fprintf(stderr, "Backend: %s %s (%s, %u CPUs, %lu MB)\n", backend->info.name,
+            backend->info.version, backend->info.arch, backend->info.n_cpus,
+            backend->info.total_memory / (1024 * 1024));
+    if ( stats.available & ODK_STATS_WALLTIME )
+        fprintf(stderr, "Elapsed time: %.2f s\n", stats.wall_time);
+    if ( stats.available & ODK_STATS_CPUTIME )
+        fprintf(stderr, "CPU time: %.2f s user, %.2f s system\n", stats.user_time, stats.system_time);
+    if ( stats.available & ODK_STATS_MEMORY )
+        fprintf(stderr, "Peak memory: %ld kb\n", stats.peak_memory);
+    if ( stats.available & ODK_STATS_IO )
+        fprintf(stderr, "Block I/O: %ld in, %ld out\n", stats.read_ops, stats.write_ops);
+}
+
 
 /* Main function. */
 
+/* The background fetch of the image, if any. */
+static odk_process_t pull;
+
+/* Terminates the image fetch if we exit before having waited for it. */
+static void
+stop_pull(void)
+{
+    stop_process(&pull);
+}
+
 int
 main(int argc, char **argv)
 {
     int c;
-    int ret = 0;
-    char *opt_value, *java_mem = NULL;
+    int ret = 0, auto_network, repo_lock = -1, lock_state, attach_state = 0;
+    char *opt_value, *java_mem = NULL, *batch_dir = NULL, **command, **pull_argv;
+    char *metrics_file = NULL;
+    int profile_files = 0;
+    char *usage_file = NULL, *endptr;
+    unsigned long usage_interval = 0;
+    double t_prepare, t_wait, t_run;
     odk_run_config_t cfg;
     odk_backend_t backend = { 0 };
+    odk_cache_locks_t cache_locks;
+    odk_run_lock_t lock;
+    odk_prefetch_t prefetch;
+    odk_run_stats_t pull_stats;
+    odk_run_record_t record = { 0 };
+    odk_shims_t shims;
+    odk_sparql_stats_t sparql_stats;
+    odk_file_profile_t file_profile = { 0 };
+    odk_usage_recorder_t usage_recorder = { 0 };
     odk_backend_init backend_init = odk_backend_docker_init;
 
     struct option options[] = {
@@ -422,6 +691,21 @@ main(int argc, char **argv)
         { "root",           0, NULL, 256 },
         { "owlapi-option",  1, NULL, 257 },
         { "java-property",  1, NULL, 258 },
+        { "dedup",          0, NULL, 259 },
+        { "priority",       1, NULL, 260 },
+        { "prefetch",       1, NULL, 261 },
+        { "pull",           0, NULL, 262 },
+        { "metrics-textfile", 1, NULL, 263 },
+        { "sparql-store",   0, NULL, 264 },
+        { "direct-user",    0, NULL, 265 },
+        { "network",        1, NULL, 266 },
+        { "profile-files",  0, NULL, 267 },
+        { "kubernetes",     0, NULL, 268 },
+        { "executors",      1, NULL, 269 },
+        { "oak-server",     0, NULL, 270 },
+        { "record-usage",   1, NULL, 271 },
+        { "usage-interval", 1, NULL, 272 },
+        { "checkpoint",     0, NULL, 273 },
         { NULL,             0, NULL, 0 }
     };
 
@@ -498,6 +782,71 @@ main(int argc, char **argv)
         case 257:
             handle_owlapi_option(&cfg, optarg);
             break;
+
+        case 259:
+            cfg.flags |= ODK_FLAG_DEDUP;
+            break;
+
+        case 260:
+            if ( odk_set_priority(&cfg, optarg, 0) == -1 )
+                errx(EXIT_FAILURE, "Invalid value for --priority option: %s", optarg);
+            break;
+
+        case 261:
+            odk_add_prefetch_pattern(&cfg, optarg);
+            break;
+
+        case 262:
+            cfg.flags |= ODK_FLAG_PULLIMAGE;
+            break;
+
+        case 263:
+            metrics_file = optarg;
+            break;
+
+        case 264:
+            cfg.flags |= ODK_FLAG_SPARQLSTORE;
+            break;
+
+        case 265:
+            cfg.flags |= ODK_FLAG_DIRECTUSER;
+            break;
+
+        case 266:
+            if ( odk_set_network(&cfg, optarg, 0) == -1 )
+                errx(EXIT_FAILURE, "Invalid value for --network option: %s", optarg);
+            break;
+
+        case 267:
+            profile_files = 1;
+            break;
+
+        case 268:
+            backend_init = odk_backend_kubernetes_init;
+            break;
+
+        case 269:
+            odk_add_env_var(&cfg, "ODK_EXECUTORS", optarg, 0);
+            break;
+
+        case 270:
+            cfg.flags |= ODK_FLAG_OAKSERVER;
+            break;
+
+        case 273:
+            cfg.flags |= ODK_FLAG_CHECKPOINT;
+            break;
+
+        case 271:
+            usage_file = optarg;
+            break;
+
+        case 272:
+            errno = 0;
+            usage_interval = strtoul(optarg, &endptr, 10);
+            if ( errno != 0 || *endptr != '\0' || usage_interval < 10 )
+                errx(EXIT_FAILURE, "Invalid value for --usage-interval option: %s", optarg);
+            break;
         }
     }
 
@@ -508,11 +857,92 @@ main(int argc, char **argv)
     if ( optind < argc && strcmp("seed", argv[optind]) == 0 ) {
         cfg.flags |= ODK_FLAG_SEEDMODE;
         optind += 1;
+        if ( optind + 1 < argc && strcmp("--batch", argv[optind]) == 0 ) {
+            batch_dir = argv[optind + 1];
+            optind += 2;
+        }
         set_git_user(&cfg);
+    } else if ( optind < argc && strcmp("tune", argv[optind]) == 0 ) {
+        int n_options = optind - 1;
+
+        if ( ! is_odk_repository(".") )
+            errx(EXIT_FAILURE, "Tuning is only possible from the src/ontology directory of a ODK repository");
+        if ( java_mem )
+            errx(EXIT_FAILURE, "The --java-mem option cannot be used when tuning");
+        optind += 1;
+        if ( optind < argc && strcmp("--", argv[optind]) == 0 )
+            optind += 1;
+        if ( backend_init(&backend) == -1 )
+            err(EXIT_FAILURE, "Cannot initialise backend");
+
+        ret = odk_tune(&backend, argv, n_options, &argv[optind]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        odk_free_config(&cfg);
+        backend.close(&backend);
+        return ret;
+    } else if ( optind < argc && strcmp("native", argv[optind]) == 0 ) {
+        optind += 1;
+        if ( optind >= argc || strcmp("install", argv[optind]) != 0 )
+            errx(EXIT_FAILURE, "Unknown native command, expected 'native install'");
+        optind += 1;
+        if ( optind + 1 < argc && strcmp("--tag", argv[optind]) == 0 ) {
+            odk_set_image_tag(&cfg, argv[optind + 1], 0);
+            optind += 2;
+        }
+        if ( optind < argc )
+            errx(EXIT_FAILURE, "Unexpected argument: %s", argv[optind]);
+
+        if ( (ret = odk_toolchain_install(&cfg)) == -1 )
+            warn("Cannot install native toolchain");
+        odk_free_config(&cfg);
+        return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else if ( optind < argc && strcmp("cache", argv[optind]) == 0 ) {
+        optind += 1;
+        if ( is_odk_repository(".") )
+            cfg.flags |= ODK_FLAG_INODKREPO;
+
+        if ( optind + 1 == argc && strcmp("stats", argv[optind]) == 0 )
+            ret = odk_cache_stats(&cfg);
+        else if ( optind < argc && strcmp("gc", argv[optind]) == 0 ) {
+            int flags = 0;
+
+            for ( int i = optind + 1; i < argc; i++ ) {
+                if ( strcmp("--dry-run", argv[i]) == 0 )
+                    flags |= ODK_CACHE_GC_DRYRUN;
+                else if ( strcmp("--prune-images", argv[i]) == 0 )
+                    flags |= ODK_CACHE_GC_PRUNE;
+                else
+                    errx(EXIT_FAILURE, "Unexpected argument: %s", argv[i]);
+            }
+            ret = odk_cache_gc(&cfg, flags);
+        } else
+            errx(EXIT_FAILURE, "Unknown cache command, expected 'cache stats' or 'cache gc'");
+
+        if ( ret == -1 )
+            warn("Cannot process caches");
+        odk_free_config(&cfg);
+        return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-    if ( backend_init(&backend) == -1 )
+    if ( backend_init(&backend) == -1 ) {
+        record_failure(metrics_file, &cfg, &backend);
         err(EXIT_FAILURE, "Cannot initialise backend");
+    }
+
+    /* We know which image to use, start fetching it right now; the
+     * rest of the preparation will proceed in parallel. */
+    if ( (cfg.flags & ODK_FLAG_PULLIMAGE) && backend.pull_command
+            && (pull_argv = backend.pull_command(&backend, &cfg)) ) {
+        if ( start_process(pull_argv, PROCESS_QUIET, &pull) == -1 )
+            warn("Cannot fetch image");
+        else
+            atexit(stop_pull);
+    }
+    t_prepare = get_monotonic_time();
+
+    command = &argv[optind];
+    if ( batch_dir )
+        command = make_seed_batch_command(&cfg, &backend, batch_dir, command);
+    auto_network = odk_select_network(&cfg, command);
 
     set_max_java_mem(&cfg, backend.info.total_memory, java_mem);
     set_work_directory(&cfg);
@@ -520,16 +950,130 @@ main(int argc, char **argv)
     set_http_proxy(&cfg);
 
     if ( cfg.n_java_opts )
-        mr_register(NULL, odk_make_java_args(&cfg, 1), 1);
+        odk_make_java_args(&cfg, 1);
 
-    if ( cfg.oak_cache_directory && share_oaklib_cache(&cfg, cfg.oak_cache_directory) == -1 )
+    if ( cfg.oak_cache_directory && share_oaklib_cache(&cfg, cfg.oak_cache_directory) == -1 ) {
+        record_failure(metrics_file, &cfg, &backend);
         err(EXIT_FAILURE, "Cannot share OAK cache directory");
+    }
+
+    /* Prevent a cache collection from removing the caches we use. */
+    if ( (cfg.flags & ODK_FLAG_INODKREPO) && (repo_lock = odk_repository_lock(0)) == -1 )
+        warn("Cannot lock the repository");
+    odk_cache_use(&cfg, backend.info.name, &cache_locks);
+
+    odk_shims_init(&shims, &cfg, &backend);
+    if ( (cfg.flags & ODK_FLAG_SPARQLSTORE) && (cfg.flags & ODK_FLAG_INODKREPO) ) {
+        if ( odk_sparql_store_enable(&shims) == -1 )
+            warn("Cannot enable SPARQL store");
+        odk_sparql_store_get_stats(&sparql_stats);
+    }
+    if ( (cfg.flags & ODK_FLAG_OAKSERVER) && (cfg.flags & ODK_FLAG_INODKREPO)
+            && odk_oak_server_enable(&shims) == -1 )
+        warn("Cannot enable OAK server");
+    if ( (cfg.flags & ODK_FLAG_INODKREPO)
+            && ! (command = odk_dispatch_setup(&shims, &cfg, &backend, command)) ) {
+        record_failure(metrics_file, &cfg, &backend);
+        err(EXIT_FAILURE, "Cannot set up distributed execution");
+    }
+
+    /* Start reading input files now, so that it overlaps with the
+     * start of the container. */
+    if ( odk_prefetch_start(&prefetch, &cfg) == -1 )
+        warn("Cannot prefetch files");
 
     if ( backend.prepare )
         ret = backend.prepare(&backend, &cfg);
+    t_prepare = get_monotonic_time() - t_prepare;
+
+    if ( pull.pid > 0 || pull.handle ) {
+        t_wait = get_monotonic_time();
+        if ( wait_process(&pull, &pull_stats) != 0 )
+            warnx("Cannot fetch image, using local copy if any");
+        t_wait = get_monotonic_time() - t_wait;
+
+        if ( cfg.flags & ODK_FLAG_TIMEDEBUG )
+            fprintf(stderr, "### PREPARATION STATS ###\n"
+                    "Preparation: %.2f s\n"
+                    "Image fetch: %.2f s (%.2f s spent waiting)\n",
+                    t_prepare, pull_stats.wall_time, t_wait);
+    }
+
+    if ( ret == 0 ) {
+        if ( profile_files && odk_file_profile_start(&file_profile, get_work_directory(&cfg)) == -1 )
+            warn("Cannot profile file accesses");
+
+        t_run = get_monotonic_time();
+        /* If the run we attach to turns out to be over, we may have to
+         * run the command ourselves. */
+        while ( (lock_state = odk_lock_acquire(&lock, &cfg, command)) == 1
+                && (attach_state = odk_lock_attach(&lock, &ret)) == 1 )
+            ;
+        switch ( lock_state ) {
+        case -1:
+            warn("Cannot lock the repository, running anyway");
+            if ( usage_file )
+                start_usage_recorder(&usage_recorder, &cfg, &backend, usage_file, usage_interval);
+            ret = run_command(&backend, &cfg, odk_shims_wrap(&shims, command));
+            break;
+
+        case 0:
+            if ( usage_file )
+                start_usage_recorder(&usage_recorder, &cfg, &backend, usage_file, usage_interval);
+            ret = run_command(&backend, &cfg, odk_shims_wrap(&shims, command));
+            odk_lock_release(&lock, ret);
+            break;
+
+        case 1:
+            /* We only replay the output of another invocation, there
+             * is nothing meaningful to record. */
+            if ( usage_file )
+                warnx("Not recording resource usage of a command run by another invocation");
+            if ( attach_state == -1 )
+                ret = EXIT_FAILURE;
+            record.attached = 1;
+            break;
+        }
+
+        odk_file_profile_finish(&file_profile, stderr);
+        if ( usage_file && odk_usage_recorder_finish(&usage_recorder) == -1 )
+            warn("Cannot write resource usage to %s", usage_file);
+
+        if ( metrics_file ) {
+            record.backend = backend.info.name;
+            record.status = ret;
+            record.duration = get_monotonic_time() - t_run;
+            record.killed = backend.last_run.killed;
+            if ( odk_metrics_update(metrics_file, &cfg, &record) == -1 )
+                warn("Cannot update metrics file %s", metrics_file);
+        }
+
+        if ( cfg.flags & ODK_FLAG_TIMEDEBUG ) {
+            print_run_stats(&backend);
+            fprintf(stderr, "Network: %s%s\n", odk_get_network_name(cfg.network),
+                    auto_network ? " (selected from the targets)" : "");
+            odk_prefetch_stop(&prefetch);
+            if ( prefetch.n_files > 0 )
+                fprintf(stderr, "Prefetched: %zu/%zu files (%llu MB) in %.2f s\n",
+                        prefetch.n_done, prefetch.n_files,
+                        prefetch.bytes_done / (1024 * 1024), prefetch.duration);
+            if ( shims.count > 0 && (cfg.flags & ODK_FLAG_SPARQLSTORE) ) {
+                odk_sparql_stats_t after;
+
+                odk_sparql_store_get_stats(&after);
+                fprintf(stderr, "SPARQL store: %lu hits, %lu loads, %lu passed to ROBOT\n",
+                        after.hits - sparql_stats.hits, after.loads - sparql_stats.loads,
+                        after.fallbacks - sparql_stats.fallbacks);
+            }
+        }
+    } else
+        record_failure(metrics_file, &cfg, &backend);
+
+    odk_shims_cleanup(&shims);
+    odk_unlock(repo_lock);
+    odk_cache_release(&cache_locks);
 
-    if ( ret == 0 )
-        ret = backend.run(&backend, &cfg, &argv[optind]);
+    odk_prefetch_finish(&prefetch);
 
     odk_free_config(&cfg);
     backend.close(&backend);
@@ -0,0 +1,246 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "prefetch.h"
+
+#include <string.h>
+#include <errno.h>
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_GLOB_H)
+#define ODK_PREFETCH_SUPPORTED
+#include <pthread.h>
+#include <glob.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#endif
+
+#include <xmem.h>
+
+#include "util.h"
+
+/*
+ * Prefetching of input files.
+ *
+ * Commands run in the ODK often start by reading large ontology files.
+ * If those files are not already in the page cache, reading them from
+ * disk can take a while -- time that is added to the time needed to
+ * start the container. To overlap both, we ask the kernel to start
+ * reading the files in the background, from a few threads, while the
+ * backend is busy starting the container.
+ */
+
+#if defined(ODK_PREFETCH_SUPPORTED)
+
+/* Private state shared between the threads. */
+typedef struct prefetch_threads {
+    pthread_mutex_t lock;
+    pthread_t       threads[ODK_PREFETCH_THREADS];
+} prefetch_threads_t;
+
+/* Advises the kernel that we will need the contents of the file. */
+static off_t
+prefetch_file(const char *path)
+{
+    int fd;
+    struct stat st;
+    off_t size = 0;
+
+    if ( (fd = open(path, O_RDONLY)) == -1 )
+        return 0;
+
+    if ( fstat(fd, &st) != -1 && S_ISREG(st.st_mode) ) {
+        size = st.st_size;
+#if defined(HAVE_POSIX_FADVISE)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#elif defined(F_RDADVISE)
+        struct radvisory ra;
+
+        ra.ra_offset = 0;
+        ra.ra_count = size > INT_MAX ? INT_MAX : size;
+        fcntl(fd, F_RDADVISE, &ra);
+#else
+        /* No way to advise the kernel, read the file ourselves. */
+        char buffer[65536];
+
+        while ( read(fd, buffer, sizeof(buffer)) > 0 ) ;
+#endif
+    }
+
+    close(fd);
+
+    return size;
+}
+
+static void *
+prefetch_thread(void *arg)
+{
+    odk_prefetch_t *pf = arg;
+    prefetch_threads_t *pt = pf->priv;
+    const char *path;
+    off_t size;
+
+    for ( ;; ) {
+        pthread_mutex_lock(&pt->lock);
+        path = pf->stop || pf->next >= pf->n_files ? NULL : pf->files[pf->next++];
+        pthread_mutex_unlock(&pt->lock);
+
+        if ( ! path )
+            break;
+
+        size = prefetch_file(path);
+
+        pthread_mutex_lock(&pt->lock);
+        pf->n_done += 1;
+        pf->bytes_done += size;
+        pf->duration = get_monotonic_time() - pf->start;
+        pthread_mutex_unlock(&pt->lock);
+    }
+
+    return NULL;
+}
+
+#endif /* ODK_PREFETCH_SUPPORTED */
+
+/**
+ * Starts prefetching the files matching the patterns found in the
+ * configuration. This function returns immediately, while the files
+ * are being prefetched in the background.
+ *
+ * @param pf  The prefetch object to initialise.
+ * @param cfg The ODK configuration.
+ *
+ * @return 0 if successful (including if there is nothing to
+ *         prefetch), or -1 if an error occured (check errno for
+ *         details).
+ */
+int
+odk_prefetch_start(odk_prefetch_t *pf, odk_run_config_t *cfg)
+{
+    memset(pf, 0, sizeof(odk_prefetch_t));
+
+    if ( cfg->n_prefetch_patterns == 0 )
+        return 0;
+
+#if defined(ODK_PREFETCH_SUPPORTED)
+    glob_t gl;
+    prefetch_threads_t *pt;
+    int flags = 0;
+
+    for ( size_t i = 0; i < cfg->n_prefetch_patterns; i++ ) {
+        glob(cfg->prefetch_patterns[i], flags, NULL, &gl);
+        flags = GLOB_APPEND;
+    }
+
+    if ( gl.gl_pathc > 0 ) {
+        pf->files = xmalloc(sizeof(char *) * gl.gl_pathc);
+        for ( size_t i = 0; i < gl.gl_pathc; i++ )
+            pf->files[pf->n_files++] = xstrdup(gl.gl_pathv[i]);
+    }
+    globfree(&gl);
+
+    if ( pf->n_files == 0 )
+        return 0;
+
+    pt = xmalloc(sizeof(prefetch_threads_t));
+    pthread_mutex_init(&pt->lock, NULL);
+    pf->priv = pt;
+    pf->start = get_monotonic_time();
+
+    for ( unsigned i = 0; i < ODK_PREFETCH_THREADS && i < pf->n_files; i++ ) {
+        if ( pthread_create(&pt->threads[i], NULL, prefetch_thread, pf) != 0 )
+            break;
+        pf->n_threads += 1;
+    }
+
+    if ( pf->n_threads == 0 ) {
+        odk_prefetch_finish(pf);
+        return -1;
+    }
+
+    return 0;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * Stops prefetching files and waits for the background threads to
+ * terminate. Files that have not been prefetched yet are not prefetched
+ * at all. Once this function returns, the statistics in the prefetch
+ * object can be read safely.
+ *
+ * @param pf The prefetch object.
+ */
+void
+odk_prefetch_stop(odk_prefetch_t *pf)
+{
+#if defined(ODK_PREFETCH_SUPPORTED)
+    prefetch_threads_t *pt = pf->priv;
+
+    if ( pt ) {
+        pthread_mutex_lock(&pt->lock);
+        pf->stop = 1;
+        pthread_mutex_unlock(&pt->lock);
+
+        for ( unsigned i = 0; i < pf->n_threads; i++ )
+            pthread_join(pt->threads[i], NULL);
+
+        pthread_mutex_destroy(&pt->lock);
+        free(pt);
+        pf->priv = NULL;
+    }
+#else
+    (void) pf;
+#endif
+}
+
+/**
+ * Stops prefetching files and releases all associated resources.
+ *
+ * @param pf The prefetch object.
+ */
+void
+odk_prefetch_finish(odk_prefetch_t *pf)
+{
+    odk_prefetch_stop(pf);
+
+    for ( size_t i = 0; i < pf->n_files; i++ )
+        free(pf->files[i]);
+    free(pf->files);
+    pf->files = NULL;
+    pf->n_files = 0;
+}
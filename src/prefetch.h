@@ -0,0 +1,69 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ICP20261018_PREFETCH_H
+#define ICP20261018_PREFETCH_H
+
+#include "runner.h"
+
+#define ODK_PREFETCH_THREADS 4
+
+/* State of a background prefetch operation. */
+typedef struct odk_prefetch {
+    char      **files;
+    size_t      n_files;
+    size_t      next;
+    int         stop;
+    unsigned    n_threads;
+    size_t      n_done;
+    unsigned long long bytes_done;
+    double      start;
+    double      duration;
+    void       *priv;
+} odk_prefetch_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int
+odk_prefetch_start(odk_prefetch_t *, odk_run_config_t *);
+
+void
+odk_prefetch_stop(odk_prefetch_t *);
+
+void
+odk_prefetch_finish(odk_prefetch_t *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !ICP20261018_PREFETCH_H */
@@ -40,41 +40,118 @@
 
 #if defined(HAVE_SYS_WAIT_H)
 #include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#if defined(ODK_RUNNER_LINUX)
+#include <sys/syscall.h>
+#endif
 #elif defined(HAVE_WINDOWS_H)
 #include <windows.h>
 #include <sbuffer.h>
 #endif
 
-/**
- * Spawns a new process to execute the specified command.
- *
- * @param argv The command to execute, as a NULL-terminated array of
- *             arguments.
- *
- * @return 0 if successful, or -1 if an error occured.
- */
-int
-spawn_process(char **argv)
-{
+#include "util.h"
+
 #if defined(HAVE_SYS_WAIT_H)
-    pid_t pid;
 
-    if ( (pid = fork()) == 0 ) {
-        execvp(argv[0], argv);
-        exit(EXIT_FAILURE);
-    } else if ( pid > 0 ) {
-        int status;
+/* Waits for a child process to terminate and collects its resource
+ * usage figures. */
+static int
+wait_for_process(pid_t pid, double start, odk_run_stats_t *stats)
+{
+    int status;
+    struct rusage ru;
+
+    if ( wait4(pid, &status, 0, &ru) == -1 )
+        return -1;
+
+    if ( stats ) {
+        stats->available = ODK_STATS_WALLTIME | ODK_STATS_CPUTIME | ODK_STATS_MEMORY | ODK_STATS_IO;
+        stats->wall_time = get_monotonic_time() - start;
+        stats->user_time = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0;
+        stats->system_time = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0;
+#if defined(ODK_RUNNER_MACOS)
+        stats->peak_memory = ru.ru_maxrss / 1024;   /* Reported in bytes */
+#else
+        stats->peak_memory = ru.ru_maxrss;
+#endif
+        stats->read_ops = ru.ru_inblock;
+        stats->write_ops = ru.ru_oublock;
+        /* SIGKILL is what the OOM killer sends. */
+        stats->killed = WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL;
+    }
 
-        if ( waitpid(pid, &status, 0) != -1 ) {
-            if ( WIFEXITED(status) )
-                return WEXITSTATUS(status);
+    if ( WIFEXITED(status) )
+        return WEXITSTATUS(status);
+
+    return -1;
+}
+
+/* Bits of the Linux I/O priority interface that are not exposed by
+ * the C library. */
+#define IOPRIO_WHO_PROCESS          1
+#define IOPRIO_CLASS_BE             2
+#define IOPRIO_CLASS_IDLE           3
+#define IOPRIO_PRIO_VALUE(cls, lvl) (((cls) << 13) | (lvl))
+
+/*
+ * Sets the CPU and I/O scheduling priority of the current process,
+ * and how likely it is to be picked by the OOM killer. Intended to be
+ * called in a child process before executing a command. Errors are
+ * ignored, since raising the priority typically requires privileges
+ * we may not have.
+ */
+static void
+set_priority(int priority)
+{
+#if defined(ODK_RUNNER_LINUX)
+    int fd;
+#endif
+
+    if ( priority == ODK_PRIORITY_BACKGROUND ) {
+        setpriority(PRIO_PROCESS, 0, 10);
+#if defined(ODK_RUNNER_LINUX)
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0));
+        if ( (fd = open("/proc/self/oom_score_adj", O_WRONLY)) != -1 ) {
+            /* Failing to adjust the OOM score is not a problem. */
+            (void) !write(fd, "500", 3);
+            close(fd);
         }
+#elif defined(ODK_RUNNER_MACOS)
+        setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_PROCESS, IOPOL_THROTTLE);
+#endif
+    } else if ( priority == ODK_PRIORITY_HIGH ) {
+        setpriority(PRIO_PROCESS, 0, -5);
+#if defined(ODK_RUNNER_LINUX)
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_PRIO_VALUE(IOPRIO_CLASS_BE, 0));
+#endif
     }
+}
 
 #elif defined(HAVE_WINDOWS_H)
-    STARTUPINFO si;
-    PROCESS_INFORMATION pi;
+
+/* Converts a FILETIME duration to seconds. */
+static double
+filetime_to_seconds(FILETIME *ft)
+{
+    ULARGE_INTEGER li;
+
+    li.LowPart = ft->dwLowDateTime;
+    li.HighPart = ft->dwHighDateTime;
+
+    return li.QuadPart / 10000000.0;
+}
+
+#endif
+
+#if defined(HAVE_WINDOWS_H)
+
+/* Assembles a Windows command line from an array of arguments. */
+static char *
+make_command_line(char **argv)
+{
     string_buffer_t sb;
     char **cursor, *cmd;
 
@@ -90,27 +167,261 @@ spawn_process(char **argv)
     cmd = sb_get_copy(&sb);
     free(sb.buffer);
 
+    return cmd;
+}
+
+#endif
+
+/**
+ * Starts a new process to execute the specified command, without
+ * waiting for it to terminate.
+ *
+ * @param argv  The command to execute, as a NULL-terminated array of
+ *              arguments.
+ * @param flags If PROCESS_QUIET is set, the standard output of the
+ *              new process is discarded.
+ * @param proc  The process object to initialise; it must be passed
+ *              to wait_process later.
+ *
+ * @return 0 if successful, or -1 if an error occured.
+ */
+int
+start_process(char **argv, int flags, odk_process_t *proc)
+{
+    proc->pid = -1;
+    proc->handle = NULL;
+    proc->start = get_monotonic_time();
+
+#if defined(HAVE_SYS_WAIT_H)
+    pid_t pid;
+
+    if ( (pid = fork()) == 0 ) {
+        if ( flags & PROCESS_QUIET ) {
+            int fd;
+
+            if ( (fd = open("/dev/null", O_WRONLY)) != -1 ) {
+                dup2(fd, STDOUT_FILENO);
+                close(fd);
+            }
+        }
+        execvp(argv[0], argv);
+        _exit(127);
+    } else if ( pid > 0 ) {
+        proc->pid = pid;
+        return 0;
+    }
+
+#elif defined(HAVE_WINDOWS_H)
+    STARTUPINFO si;
+    PROCESS_INFORMATION pi;
+    char *cmd;
+    HANDLE null_handle = INVALID_HANDLE_VALUE;
+    SECURITY_ATTRIBUTES sa;
+
+    cmd = make_command_line(argv);
+
     ZeroMemory(&si, sizeof(si));
     si.cb = sizeof(si);
     ZeroMemory(&pi, sizeof(pi));
 
+    if ( flags & PROCESS_QUIET ) {
+        sa.nLength = sizeof(sa);
+        sa.lpSecurityDescriptor = NULL;
+        sa.bInheritHandle = TRUE;
+        null_handle = CreateFile("NUL", GENERIC_WRITE, FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, NULL);
+        if ( null_handle != INVALID_HANDLE_VALUE ) {
+            si.dwFlags = STARTF_USESTDHANDLES;
+            si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+            si.hStdOutput = null_handle;
+            si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+        }
+    }
+
     if ( CreateProcess(NULL, cmd, NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi) ) {
+        CloseHandle(pi.hThread);
+        proc->handle = pi.hProcess;
+    }
+
+    if ( null_handle != INVALID_HANDLE_VALUE )
+        CloseHandle(null_handle);
+    free(cmd);
+
+    if ( proc->handle )
+        return 0;
+
+#else
+    (void) argv;
+    (void) flags;
+
+    errno = ENOSYS;
+
+#endif
+    return -1;
+}
+
+/**
+ * Waits for a process started with start_process to terminate.
+ *
+ * @param proc  The process to wait for.
+ * @param stats If not NULL, will be filled with the resource usage
+ *              figures of the process.
+ *
+ * @return The exit code of the process, or -1 if an error occured.
+ */
+int
+wait_process(odk_process_t *proc, odk_run_stats_t *stats)
+{
+#if defined(HAVE_SYS_WAIT_H)
+    if ( proc->pid > 0 ) {
+        pid_t pid = proc->pid;
+
+        proc->pid = -1;
+        return wait_for_process(pid, proc->start, stats);
+    }
+
+#elif defined(HAVE_WINDOWS_H)
+    if ( proc->handle ) {
         DWORD status;
 
-        WaitForSingleObject(pi.hProcess, INFINITE);
-        GetExitCodeProcess(pi.hProcess, &status);
+        WaitForSingleObject(proc->handle, INFINITE);
+        GetExitCodeProcess(proc->handle, &status);
 
-        CloseHandle(pi.hProcess);
-        CloseHandle(pi.hThread);
+        if ( stats ) {
+            FILETIME creation, exit, kernel, user;
+            IO_COUNTERS io;
+
+            stats->available = ODK_STATS_WALLTIME;
+            stats->wall_time = get_monotonic_time() - proc->start;
+            stats->killed = 0;
+            if ( GetProcessTimes(proc->handle, &creation, &exit, &kernel, &user) ) {
+                stats->available |= ODK_STATS_CPUTIME;
+                stats->user_time = filetime_to_seconds(&user);
+                stats->system_time = filetime_to_seconds(&kernel);
+            }
+            if ( GetProcessIoCounters(proc->handle, &io) ) {
+                stats->available |= ODK_STATS_IO;
+                stats->read_ops = io.ReadOperationCount;
+                stats->write_ops = io.WriteOperationCount;
+            }
+        }
 
-        free(cmd);
+        CloseHandle(proc->handle);
+        proc->handle = NULL;
 
         return status;
     }
 
-    free(cmd);
+#else
+    (void) proc;
+    (void) stats;
+
+    errno = ENOSYS;
+
+#endif
+    return -1;
+}
+
+/**
+ * Terminates a process started with start_process, and waits for it.
+ * This does nothing if the process has already been waited for.
+ *
+ * @param proc The process to terminate.
+ */
+void
+stop_process(odk_process_t *proc)
+{
+#if defined(HAVE_SYS_WAIT_H)
+    if ( proc->pid > 0 ) {
+        kill(proc->pid, SIGTERM);
+        waitpid(proc->pid, NULL, 0);
+        proc->pid = -1;
+    }
+
+#elif defined(HAVE_WINDOWS_H)
+    if ( proc->handle ) {
+        TerminateProcess(proc->handle, 1);
+        WaitForSingleObject(proc->handle, INFINITE);
+        CloseHandle(proc->handle);
+        proc->handle = NULL;
+    }
+
+#else
+    (void) proc;
+
+#endif
+}
+
+/**
+ * Spawns a new process to execute the specified command.
+ *
+ * @param argv  The command to execute, as a NULL-terminated array of
+ *              arguments.
+ * @param stats If not NULL, will be filled with the resource usage
+ *              figures of the process.
+ *
+ * @return The exit code of the command, or -1 if an error occured.
+ */
+int
+spawn_process(char **argv, odk_run_stats_t *stats)
+{
+#if defined(HAVE_SYS_WAIT_H)
+    return spawn_process_env(argv, NULL, 0, ODK_PRIORITY_NORMAL, stats);
+#else
+    odk_process_t proc;
+
+    if ( start_process(argv, 0, &proc) == -1 )
+        return -1;
+
+    return wait_process(&proc, stats);
+#endif
+}
+
+/**
+ * Spawns a new process to execute the specified command, with
+ * additional environment variables. The environment of the calling
+ * process is left untouched.
+ *
+ * @param argv  The command to execute, as a NULL-terminated array of
+ *              arguments.
+ * @param env   The variables to set in the environment of the new
+ *              process; variables with a NULL value are removed from
+ *              the environment.
+ * @param n_env The number of variables in the env array.
+ * @param prio  The scheduling priority (one of the ODK_PRIORITY_*
+ *              values) of the new process.
+ * @param stats If not NULL, will be filled with the resource usage
+ *              figures of the process.
+ *
+ * @return The exit code of the command, or -1 if an error occured.
+ */
+int
+spawn_process_env(char **argv, odk_var_t *env, size_t n_env, int prio, odk_run_stats_t *stats)
+{
+#if defined(HAVE_SYS_WAIT_H)
+    pid_t pid;
+    double start;
+
+    start = get_monotonic_time();
+    if ( (pid = fork()) == 0 ) {
+        for ( size_t i = 0; i < n_env; i++ ) {
+            if ( env[i].value != NULL )
+                setenv(env[i].name, env[i].value, 1);
+            else
+                unsetenv(env[i].name);
+        }
+        set_priority(prio);
+        execvp(argv[0], argv);
+        _exit(127);
+    } else if ( pid > 0 )
+        return wait_for_process(pid, start, stats);
 
 #else
+    (void) argv;
+    (void) env;
+    (void) n_env;
+    (void) prio;
+    (void) stats;
+
     errno = ENOSYS;
 
 #endif
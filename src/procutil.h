@@ -31,12 +31,35 @@
 #ifndef ICP20240210_PROCUTIL_H
 #define ICP20240210_PROCUTIL_H
 
+#include "backend.h"
+
+/* A process running in the background. */
+typedef struct odk_process {
+    long    pid;
+    void   *handle;
+    double  start;
+} odk_process_t;
+
+#define PROCESS_QUIET   0x0001
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int
-spawn_process(char **);
+start_process(char **, int, odk_process_t *);
+
+int
+wait_process(odk_process_t *, odk_run_stats_t *);
+
+void
+stop_process(odk_process_t *);
+
+int
+spawn_process(char **, odk_run_stats_t *);
+
+int
+spawn_process_env(char **, odk_var_t *, size_t, int, odk_run_stats_t *);
 
 #ifdef __cplusplus
 }
@@ -40,12 +40,10 @@
 #include <xmem.h>
 
 #include "util.h"
-#include "memreg.h"
+#include <memreg.h>
 #include "oaklib.h"
 #include "owlapi.h"
 
-#define RUNCONF_FILENAME "run.sh.conf"
-
 
 /**
  * Parses a volume binding specification (of the kind expected by
@@ -97,7 +95,7 @@ process_bind_spec(char *spec, size_t lineno, odk_run_config_t *cfg)
         }
     }
 
-    if ( odk_add_binding(cfg, spec, mr_strdup(NULL, dst), ODK_NO_OVERWRITE) == -1 ) {
+    if ( odk_add_binding(cfg, spec, mr_strdup(&cfg->mr, dst), ODK_NO_OVERWRITE) == -1 ) {
         warn(RUNCONF_FILENAME ":%lu:Cannot add binding \"%s:%s\"", lineno, spec, dst);
         return -1;
     }
@@ -153,19 +151,58 @@ process_line(char *line, size_t len, size_t lineno, odk_run_config_t *cfg)
             if ( value_len == 0 )
                 DO_WARN("Ignoring empty value for option \"%s\"", line);
             else if ( strcmp(line, "ODK_IMAGE") == 0 )
-                odk_set_image_name(cfg, mr_strdup(NULL, value), ODK_NO_OVERWRITE);
+                odk_set_image_name(cfg, mr_strdup(&cfg->mr, value), ODK_NO_OVERWRITE);
             else if ( strcmp(line, "ODK_TAG") == 0 )
-                odk_set_image_tag(cfg, mr_strdup(NULL, value), ODK_NO_OVERWRITE);
+                odk_set_image_tag(cfg, mr_strdup(&cfg->mr, value), ODK_NO_OVERWRITE);
             else if ( strcmp(line, "ODK_SHARE_OAK_CACHE") == 0 )
-                odk_set_oak_cache_directory(cfg, mr_strdup(NULL, value), ODK_NO_OVERWRITE);
-            else if ( strcmp(line, "ODK_DEBUG") == 0 && strcmp(value, "yes") == 0 ) {
+                odk_set_oak_cache_directory(cfg, mr_strdup(&cfg->mr, value), ODK_NO_OVERWRITE);
+            else if ( strcmp(line, "ODK_PRIORITY") == 0 ) {
+                if ( odk_set_priority(cfg, value, ODK_NO_OVERWRITE) == -1 )
+                    DO_WARN("Ignoring invalid \"ODK_PRIORITY\" value \"%s\"", value);
+            } else if ( strcmp(line, "ODK_NETWORK") == 0 ) {
+                if ( odk_set_network(cfg, value, ODK_NO_OVERWRITE) == -1 )
+                    DO_WARN("Ignoring invalid \"ODK_NETWORK\" value \"%s\"", value);
+            } else if ( strcmp(line, "ODK_OFFLINE_TARGETS") == 0 || strcmp(line, "ODK_HOST_NETWORK_TARGETS") == 0 ) {
+                int network = line[4] == 'O' ? ODK_NETWORK_NONE : ODK_NETWORK_HOST;
+                char *token;
+
+                while ( (token = strtok(value, " ")) ) {
+                    odk_add_network_rule(cfg, mr_strdup(&cfg->mr, token), network);
+                    value = NULL;
+                }
+            } else if ( strcmp(line, "ODK_DEBUG") == 0 && strcmp(value, "yes") == 0 ) {
                 cfg->flags |= ODK_FLAG_TIMEDEBUG;
                 odk_add_env_var(cfg, "ODK_DEBUG", "yes", ODK_NO_OVERWRITE);
+            } else if ( strcmp(line, "ODK_DIRECT_USER") == 0 && strcmp(value, "yes") == 0 ) {
+                cfg->flags |= ODK_FLAG_DIRECTUSER;
+            } else if ( strcmp(line, "ODK_DEDUP") == 0 && strcmp(value, "yes") == 0 ) {
+                cfg->flags |= ODK_FLAG_DEDUP;
+            } else if ( strcmp(line, "ODK_SPARQL_STORE") == 0 && strcmp(value, "yes") == 0 ) {
+                cfg->flags |= ODK_FLAG_SPARQLSTORE;
+            } else if ( strcmp(line, "ODK_OAK_SERVER") == 0 && strcmp(value, "yes") == 0 ) {
+                cfg->flags |= ODK_FLAG_OAKSERVER;
+            } else if ( strcmp(line, "ODK_CHECKPOINT") == 0 && strcmp(value, "yes") == 0 ) {
+                cfg->flags |= ODK_FLAG_CHECKPOINT;
+            } else if ( strcmp(line, "ODK_JOBS") == 0 ) {
+                char *end;
+                unsigned long jobs = strtoul(value, &end, 10);
+
+                if ( *end != '\0' || jobs == 0 )
+                    DO_WARN("Ignoring invalid \"ODK_JOBS\" value \"%s\"", value);
+                else
+                    odk_add_env_var(cfg, "MAKEFLAGS", mr_sprintf(&cfg->mr, "-j%lu", jobs), ODK_NO_OVERWRITE);
             } else if ( strcmp(line, "ODK_JAVA_OPTS") == 0 ) {
                 char * token;
 
                 while ( (token = strtok(value, " ")) ) {
-                    odk_add_java_opt(cfg, mr_strdup(NULL, token), ODK_NO_OVERWRITE);
+                    odk_add_java_opt(cfg, mr_strdup(&cfg->mr, token), ODK_NO_OVERWRITE);
+                    value = NULL;
+                }
+            } else if ( strcmp(line, "ODK_PREFETCH") == 0 ) {
+                char *token;
+
+                while ( (token = strtok(value, " ")) ) {
+                    odk_add_prefetch_pattern(cfg, mr_strdup(&cfg->mr, token));
                     value = NULL;
                 }
             } else if ( strcmp(line, "ODK_BINDS") == 0 ) {
@@ -179,7 +216,7 @@ process_line(char *line, size_t len, size_t lineno, odk_run_config_t *cfg)
                 char *property, *errmsg = NULL;
 
                 if ( get_owlapi_java_property_from_name(line + 7, value, &property, &errmsg) != -1 )
-                    odk_add_java_property(cfg, property, mr_strdup(NULL, value), ODK_NO_OVERWRITE);
+                    odk_add_java_property(cfg, property, mr_strdup(&cfg->mr, value), ODK_NO_OVERWRITE);
                 else {
                     DO_WARN("Ignoring invalid OWLAPI option \"%s=%s\": %s", line + 7, value, errmsg);
                     free(errmsg);
@@ -193,7 +230,7 @@ process_line(char *line, size_t len, size_t lineno, odk_run_config_t *cfg)
                     DO_WARN("Ignoring \"ODK_USER_ID\" with value other than 0 (%s)", value);
             } else
                 /* Pass any other option as an environment variable */
-                odk_add_env_var(cfg, mr_strdup(NULL, line), mr_strdup(NULL, value), ODK_NO_OVERWRITE);
+                odk_add_env_var(cfg, mr_strdup(&cfg->mr, line), mr_strdup(&cfg->mr, value), ODK_NO_OVERWRITE);
         }
     }
 
@@ -33,6 +33,8 @@
 
 #include "runner.h"
 
+#define RUNCONF_FILENAME "run.sh.conf"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
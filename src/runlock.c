@@ -0,0 +1,682 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "runlock.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+
+#if !defined(ODK_RUNNER_WINDOWS)
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <glob.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#endif
+
+#include <xmem.h>
+
+#include "util.h"
+
+/*
+ * Deduplication of concurrent invocations.
+ *
+ * When deduplication is enabled and an invocation of the form "odkrun
+ * make ..." is started from within a ODK repository, we take a lock on
+ * a file whose name is derived from the image and the command line.
+ * The invocation that gets the lock ("owner") runs the command
+ * normally, but copies its standard output and standard error (unless
+ * they are terminals, which are left untouched) to two log files, and
+ * records the exit status of the command once it is done. Any other
+ * identical invocation started while the lock is held simply replays
+ * the log files as they are being written, waits for the run to
+ * terminate, and returns the recorded exit status.
+ *
+ * Each run has its own ID. The owner writes to fresh log files named
+ * after it, and only publishes the ID in the lock file once they have
+ * been created; it writes the exit status to a file also named after
+ * the ID, and clears the lock file before releasing the lock. A process
+ * attaching to a run thus only ever replays the logs and returns the
+ * status of that very run. If that run is over by the time we attach
+ * to it (its status has been removed by a newer owner, or it never
+ * recorded one), the invocation tries again to get the lock, and runs
+ * the command itself if it can.
+ *
+ * The key identifying an invocation covers everything that may change
+ * the outcome of the command: the image, the command line, and the
+ * environment variables, Java options, and bindings of the container.
+ *
+ * All the files are kept under the tmp/odkrun directory of the
+ * repository:
+ * - run-KEY.lock:       the lock itself, containing the ID of the run;
+ * - run-KEY.cmd:        the command line (for information only);
+ * - run-KEY.ID.out:     the standard output of the run ID;
+ * - run-KEY.ID.err:     the standard error of the run ID;
+ * - run-KEY.ID.status:  the exit status of the run ID.
+ */
+
+#if !defined(ODK_RUNNER_WINDOWS)
+
+#define POLL_INTERVAL 200000    /* microseconds */
+
+/* Flags that change how the command is run. */
+#define KEY_FLAGS (ODK_FLAG_RUNASROOT | ODK_FLAG_SEEDMODE | ODK_FLAG_SEEDBATCH | ODK_FLAG_DIRECTUSER \
+                   | ODK_FLAG_SPARQLSTORE | ODK_FLAG_OAKSERVER | ODK_FLAG_CHECKPOINT)
+
+static unsigned long long
+hash_string(unsigned long long hash, const char *str)
+{
+    /* A NULL string (e.g. an unset variable) is hashed as a lone NUL,
+     * unlike the empty string. */
+    if ( ! str )
+        return hash_fnv1a(hash, "", 1);
+
+    return hash_fnv1a(hash_fnv1a(hash, "=", 1), str, strlen(str) + 1);
+}
+
+/* Computes the key identifying an invocation. */
+static unsigned long long
+get_invocation_key(odk_run_config_t *cfg, char **command)
+{
+    unsigned long long hash = FNV1A_INIT;
+    unsigned flags = cfg->flags & KEY_FLAGS;
+    char **cursor;
+
+    hash = hash_string(hash, cfg->image_name);
+    hash = hash_string(hash, cfg->image_tag);
+    hash = hash_string(hash, cfg->work_directory);
+    for ( cursor = command; *cursor; cursor++ )
+        hash = hash_string(hash, *cursor);
+
+    for ( size_t i = 0; i < cfg->n_env_vars; i++ ) {
+        hash = hash_string(hash, cfg->env_vars[i].name);
+        hash = hash_string(hash, cfg->env_vars[i].value);
+    }
+    for ( size_t i = 0; i < cfg->n_java_opts; i++ ) {
+        hash = hash_string(hash, cfg->java_opts[i].name);
+        hash = hash_string(hash, cfg->java_opts[i].value);
+    }
+    for ( size_t i = 0; i < cfg->n_bindings; i++ ) {
+        hash = hash_string(hash, cfg->bindings[i].host_directory);
+        hash = hash_string(hash, cfg->bindings[i].container_directory);
+    }
+
+    hash = hash_fnv1a(hash, &flags, sizeof(flags));
+    hash = hash_fnv1a(hash, &cfg->priority, sizeof(cfg->priority));
+    hash = hash_fnv1a(hash, &cfg->network, sizeof(cfg->network));
+
+    return hash;
+}
+
+/* Writes the entire buffer to the specified file descriptor. */
+static void
+write_all(int fd, const char *buffer, size_t len)
+{
+    ssize_t n;
+
+    while ( len > 0 ) {
+        if ( (n = write(fd, buffer, len)) == -1 ) {
+            if ( errno == EINTR )
+                continue;
+            return;
+        }
+        buffer += n;
+        len -= n;
+    }
+}
+
+/* Writes a small text file next to the lock file. */
+static void
+write_state_file(const char *base, const char *ext, char **lines)
+{
+    char *path;
+    FILE *f;
+
+    xasprintf(&path, "%s.%s", base, ext);
+    if ( (f = fopen(path, "w")) ) {
+        for ( ; *lines; lines++ )
+            fprintf(f, "%s\n", *lines);
+        fclose(f);
+    }
+    free(path);
+}
+
+/* Removes the files left behind by previous runs. */
+static void
+remove_old_runs(odk_run_lock_t *lock)
+{
+    const char *patterns[] = { "%s.*.out", "%s.*.err", "%s.*.status", NULL };
+    char *pattern;
+    glob_t files;
+
+    for ( const char **cursor = patterns; *cursor; cursor++ ) {
+        xasprintf(&pattern, *cursor, lock->base);
+        if ( glob(pattern, 0, NULL, &files) == 0 ) {
+            for ( size_t i = 0; i < files.gl_pathc; i++ )
+                unlink(files.gl_pathv[i]);
+            globfree(&files);
+        }
+        free(pattern);
+    }
+}
+
+/* Opens one of the files of the current run. */
+static int
+open_run_file(odk_run_lock_t *lock, const char *ext, int flags)
+{
+    char *path;
+    int fd;
+
+    xasprintf(&path, "%s.%s.%s", lock->base, lock->run_id, ext);
+    fd = open(path, flags | O_CLOEXEC, 0644);
+    free(path);
+
+    return fd;
+}
+
+/*
+ * Redirects our standard output and standard error (those that are not
+ * terminals) to pipes, and forks a process that copies everything
+ * coming from each pipe to both the original stream and its log file.
+ */
+static int
+start_capture(odk_run_lock_t *lock)
+{
+    int pfd[2][2] = { { -1, -1 }, { -1, -1 } }, log_fd[2];
+    int streams[2] = { STDOUT_FILENO, STDERR_FILENO };
+    int *saved[2] = { &lock->saved_stdout, &lock->saved_stderr };
+    const char *names[2] = { "out", "err" };
+    pid_t pid;
+
+    for ( int i = 0; i < 2; i++ ) {
+        if ( (log_fd[i] = open_run_file(lock, names[i], O_WRONLY | O_CREAT | O_TRUNC)) == -1 )
+            return -1;
+        if ( ! isatty(streams[i]) && pipe(pfd[i]) == -1 )
+            return -1;
+    }
+
+    if ( pfd[0][0] == -1 && pfd[1][0] == -1 ) {
+        /* Both streams are terminals, nothing to capture. */
+        close(log_fd[0]);
+        close(log_fd[1]);
+        return 0;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    if ( (pid = fork()) == 0 ) {
+        struct pollfd fds[2];
+        char buffer[4096];
+        ssize_t n;
+        int open_fds = 0;
+
+        /* Interrupting the command must not prevent us from getting
+         * whatever it outputs until it terminates. */
+        signal(SIGINT, SIG_IGN);
+
+        close(lock->fd);
+        for ( int i = 0; i < 2; i++ ) {
+            if ( pfd[i][1] != -1 )
+                close(pfd[i][1]);
+            fds[i].fd = pfd[i][0];
+            fds[i].events = POLLIN;
+            if ( fds[i].fd != -1 )
+                open_fds += 1;
+        }
+
+        while ( open_fds > 0 ) {
+            if ( poll(fds, 2, -1) == -1 ) {
+                if ( errno == EINTR )
+                    continue;
+                break;
+            }
+            for ( int i = 0; i < 2; i++ ) {
+                if ( fds[i].fd == -1 || fds[i].revents == 0 )
+                    continue;
+                if ( (n = read(fds[i].fd, buffer, sizeof(buffer))) > 0 ) {
+                    write_all(streams[i], buffer, n);
+                    write_all(log_fd[i], buffer, n);
+                } else if ( n == 0 || errno != EINTR ) {
+                    fds[i].fd = -1;
+                    open_fds -= 1;
+                }
+            }
+        }
+        _exit(EXIT_SUCCESS);
+    } else if ( pid == -1 ) {
+        for ( int i = 0; i < 2; i++ ) {
+            if ( pfd[i][0] != -1 ) {
+                close(pfd[i][0]);
+                close(pfd[i][1]);
+            }
+            close(log_fd[i]);
+        }
+        return -1;
+    }
+
+    for ( int i = 0; i < 2; i++ ) {
+        close(log_fd[i]);
+        if ( pfd[i][0] != -1 ) {
+            close(pfd[i][0]);
+            *saved[i] = fcntl(streams[i], F_DUPFD_CLOEXEC, 0);
+            dup2(pfd[i][1], streams[i]);
+            close(pfd[i][1]);
+        }
+    }
+    lock->tee_pid = pid;
+
+    return 0;
+}
+
+/* Restores the original standard output and standard error, and waits
+ * for the copying process to terminate. */
+static void
+stop_capture(odk_run_lock_t *lock)
+{
+    if ( lock->tee_pid > 0 ) {
+        fflush(stdout);
+        fflush(stderr);
+
+        if ( lock->saved_stdout != -1 ) {
+            dup2(lock->saved_stdout, STDOUT_FILENO);
+            close(lock->saved_stdout);
+        }
+        if ( lock->saved_stderr != -1 ) {
+            dup2(lock->saved_stderr, STDERR_FILENO);
+            close(lock->saved_stderr);
+        }
+
+        waitpid(lock->tee_pid, NULL, 0);
+        lock->tee_pid = 0;
+    }
+}
+
+/* Reads the ID of the current run from the lock file; the ID is empty
+ * if no owner has published it (yet). */
+static void
+read_run_id(odk_run_lock_t *lock, char *id, size_t len)
+{
+    ssize_t n;
+
+    if ( (n = pread(lock->fd, id, len - 1, 0)) <= 0 )
+        n = 0;
+    id[n] = '\0';
+    id[strcspn(id, "\n")] = '\0';
+}
+
+/* Checks whether the owner of a run (whose ID starts with its PID) is
+ * still alive; if not, the lock file is a leftover from a crash. */
+static int
+is_owner_alive(const char *id)
+{
+    long pid = strtol(id, NULL, 10);
+
+    return pid > 0 && (kill((pid_t)pid, 0) == 0 || errno == EPERM);
+}
+
+/* Reads the exit status of the current run, if it has been recorded. */
+static int
+read_status(odk_run_lock_t *lock, int *status)
+{
+    char buffer[16];
+    ssize_t n;
+    int fd, ret = -1;
+
+    if ( (fd = open_run_file(lock, "status", O_RDONLY)) != -1 ) {
+        if ( (n = read(fd, buffer, sizeof(buffer) - 1)) > 0 ) {
+            buffer[n] = '\0';
+            if ( sscanf(buffer, "%d", status) == 1 )
+                ret = 0;
+        }
+        close(fd);
+    }
+
+    return ret;
+}
+
+static void
+free_lock(odk_run_lock_t *lock)
+{
+    if ( lock->fd != -1 ) {
+        close(lock->fd);
+        lock->fd = -1;
+    }
+
+    free(lock->base);
+    lock->base = NULL;
+}
+
+#endif /* !ODK_RUNNER_WINDOWS */
+
+/**
+ * Attempts to get the lock for the specified invocation. This only
+ * applies to "make" commands within a ODK repository; for anything
+ * else this function does nothing and always succeeds.
+ *
+ * @param lock    The lock object to initialise.
+ * @param cfg     The ODK configuration.
+ * @param command The command to execute.
+ *
+ * @return
+ * - 0 if the lock was obtained (or no lock is needed), in which case
+ *   the caller should run the command and then call odk_lock_release;
+ * - 1 if an identical invocation is already running, in which case
+ *   the caller should call odk_lock_attach (and call this function
+ *   again if that run turns out to be over);
+ * - -1 if an error occured (check errno for details).
+ */
+int
+odk_lock_acquire(odk_run_lock_t *lock, odk_run_config_t *cfg, char **command)
+{
+    lock->fd = -1;
+    lock->base = NULL;
+    lock->saved_stdout = lock->saved_stderr = -1;
+    lock->tee_pid = 0;
+    lock->run_id[0] = '\0';
+
+#if defined(ODK_RUNNER_WINDOWS)
+    (void) cfg;
+    (void) command;
+
+    return 0;
+#else
+    char *path;
+    double now;
+
+    if ( (cfg->flags & ODK_FLAG_INODKREPO) == 0 || (cfg->flags & ODK_FLAG_DEDUP) == 0 )
+        return 0;
+    if ( ! command[0] || strcmp(command[0], "make") != 0 )
+        return 0;
+
+    if ( create_directory(ODK_RUNNER_STATE_DIR) == -1 )
+        return -1;
+
+    xasprintf(&lock->base, ODK_RUNNER_STATE_DIR "/run-%016llx", get_invocation_key(cfg, command));
+    xasprintf(&path, "%s.lock", lock->base);
+    lock->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    free(path);
+
+    if ( lock->fd == -1 ) {
+        free_lock(lock);
+        return -1;
+    }
+
+    /* The lock may also be held (shared) by processes that are done
+     * attaching to a finished run, in which case no run ID is published
+     * (or only that of an owner that crashed) and we only have to wait
+     * for them to release it. */
+    while ( flock(lock->fd, LOCK_EX | LOCK_NB) == -1 ) {
+        if ( errno != EWOULDBLOCK ) {
+            free_lock(lock);
+            return -1;
+        }
+
+        read_run_id(lock, lock->run_id, sizeof(lock->run_id));
+        if ( lock->run_id[0] != '\0' && is_owner_alive(lock->run_id) )
+            return 1;
+
+        usleep(POLL_INTERVAL);
+    }
+
+    /* We are the owner of the lock. */
+    now = get_monotonic_time();
+    snprintf(lock->run_id, sizeof(lock->run_id), "%ld-%06llx", (long)getpid(),
+             hash_fnv1a(FNV1A_INIT, &now, sizeof(now)) & 0xffffff);
+
+    write_state_file(lock->base, "cmd", command);
+
+    remove_old_runs(lock);
+    if ( ftruncate(lock->fd, 0) == -1 || start_capture(lock) == -1 ) {
+        free_lock(lock);
+        return -1;
+    }
+
+    /* Our logs exist, attachers can now follow them. */
+    dprintf(lock->fd, "%s\n", lock->run_id);
+
+    return 0;
+#endif
+}
+
+/**
+ * Follows the output of an identical invocation that is already
+ * running, until it terminates.
+ *
+ * @param lock   The lock object, as initialised by odk_lock_acquire.
+ * @param status Will be set to the exit status of the other invocation.
+ *
+ * @return
+ * - 0 if the other invocation has terminated and its exit status has
+ *   been retrieved;
+ * - 1 if the run we attached to was over and its exit status is no
+ *   longer available (or was never recorded), in which case the caller
+ *   should call odk_lock_acquire again;
+ * - -1 if an error occured (check errno for details).
+ */
+int
+odk_lock_attach(odk_run_lock_t *lock, int *status)
+{
+#if defined(ODK_RUNNER_WINDOWS)
+    (void) lock;
+    (void) status;
+
+    errno = ENOSYS;
+    return -1;
+#else
+    char buffer[4096], current[sizeof(lock->run_id)];
+    int log_fd[2], streams[2] = { STDOUT_FILENO, STDERR_FILENO };
+    int done, ret;
+    ssize_t n;
+
+    warnx("Identical command already running in this repository, attaching to it");
+
+    log_fd[0] = open_run_file(lock, "out", O_RDONLY);
+    log_fd[1] = open_run_file(lock, "err", O_RDONLY);
+
+    do {
+        /* The run is over once its status has been recorded, once we
+         * can get the lock (the owner died without recording a
+         * status), or once another run has started. In all cases the
+         * logs are complete, but we still need to copy whatever
+         * remains. */
+        done = read_status(lock, status) == 0;
+        if ( ! done && flock(lock->fd, LOCK_SH | LOCK_NB) == 0 )
+            done = 1;
+        if ( ! done ) {
+            read_run_id(lock, current, sizeof(current));
+            done = current[0] != '\0' && strcmp(current, lock->run_id) != 0;
+        }
+
+        for ( int i = 0; i < 2; i++ )
+            if ( log_fd[i] != -1 )
+                while ( (n = read(log_fd[i], buffer, sizeof(buffer))) > 0 )
+                    write_all(streams[i], buffer, n);
+
+        if ( ! done )
+            usleep(POLL_INTERVAL);
+    } while ( ! done );
+
+    for ( int i = 0; i < 2; i++ )
+        if ( log_fd[i] != -1 )
+            close(log_fd[i]);
+
+    if ( (ret = read_status(lock, status) == 0 ? 0 : 1) == 1 )
+        warnx("The other invocation is over without an exit status, running the command");
+
+    free_lock(lock);
+
+    return ret;
+#endif
+}
+
+/**
+ * Records the exit status of the command and releases the lock.
+ *
+ * @param lock   The lock object, as initialised by odk_lock_acquire.
+ * @param status The exit status of the command.
+ */
+void
+odk_lock_release(odk_run_lock_t *lock, int status)
+{
+#if defined(ODK_RUNNER_WINDOWS)
+    (void) lock;
+    (void) status;
+#else
+    if ( lock->fd != -1 ) {
+        char code[16], *lines[] = { code, NULL }, *base;
+
+        stop_capture(lock);
+
+        snprintf(code, sizeof(code), "%d", status);
+        xasprintf(&base, "%s.%s", lock->base, lock->run_id);
+        write_state_file(base, "status", lines);
+        free(base);
+        if ( ftruncate(lock->fd, 0) == -1 )
+            warn("Cannot clear lock file");
+
+        flock(lock->fd, LOCK_UN);
+        free_lock(lock);
+    }
+#endif
+}
+
+#if !defined(ODK_RUNNER_WINDOWS)
+/* Locks the specified file (created if needed), in shared or
+ * exclusive mode. */
+static int
+lock_file(const char *path, int exclusive)
+{
+    int fd;
+
+    if ( (fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) == -1 )
+        return -1;
+
+    if ( flock(fd, exclusive ? LOCK_EX | LOCK_NB : LOCK_SH) == -1 ) {
+        int saved_errno = errno;
+
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+
+    return fd;
+}
+#endif
+
+/**
+ * Locks the repository as a whole. Commands running in the repository
+ * hold a shared lock, so that the caches they may be using (OAK and
+ * SPARQL databases, checkpoints) are not removed under their feet by a
+ * cache collection, which needs an exclusive lock. This must be called
+ * from the src/ontology directory of a ODK repository.
+ *
+ * @param exclusive If non-zero, get an exclusive lock, failing with
+ *                  EWOULDBLOCK if a command is running; otherwise, get a
+ *                  shared lock, waiting for any exclusive lock to be
+ *                  released.
+ *
+ * @return A file descriptor to pass to odk_unlock to release the lock,
+ *         or -1 if an error occured (check errno for details).
+ */
+int
+odk_repository_lock(int exclusive)
+{
+#if defined(ODK_RUNNER_WINDOWS)
+    (void) exclusive;
+    errno = ENOSYS;
+    return -1;
+#else
+    if ( create_directory(ODK_RUNNER_STATE_DIR) == -1 )
+        return -1;
+
+    return lock_file(ODK_RUNNER_REPO_LOCK, exclusive);
+#endif
+}
+
+/**
+ * Locks a cache shared between repositories (such as the user's OAK
+ * cache or the native toolchains), in the same way as
+ * odk_repository_lock locks a repository. The lock file is created
+ * within the cache directory.
+ *
+ * @param directory The cache directory, which must exist.
+ * @param exclusive If non-zero, get an exclusive lock, failing with
+ *                  EWOULDBLOCK if a command is using the cache;
+ *                  otherwise, get a shared lock, waiting for any
+ *                  exclusive lock to be released.
+ *
+ * @return A file descriptor to pass to odk_unlock to release the lock,
+ *         or -1 if an error occured (check errno for details).
+ */
+int
+odk_cache_lock(const char *directory, int exclusive)
+{
+#if defined(ODK_RUNNER_WINDOWS)
+    (void) directory;
+    (void) exclusive;
+    errno = ENOSYS;
+    return -1;
+#else
+    char *path;
+    int fd;
+
+    xasprintf(&path, "%s/" ODK_RUNNER_CACHE_LOCK, directory);
+    fd = lock_file(path, exclusive);
+    free(path);
+
+    return fd;
+#endif
+}
+
+/**
+ * Releases a lock obtained with odk_repository_lock or odk_cache_lock.
+ *
+ * @param fd The file descriptor returned when getting the lock; -1 is
+ *           accepted and ignored.
+ */
+void
+odk_unlock(int fd)
+{
+#if defined(ODK_RUNNER_WINDOWS)
+    (void) fd;
+#else
+    if ( fd != -1 )
+        close(fd);
+#endif
+}
@@ -0,0 +1,82 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ICP20261018_RUNLOCK_H
+#define ICP20261018_RUNLOCK_H
+
+#include "runner.h"
+
+/* Directory (relative to src/ontology) where odkrun keeps its state. */
+#define ODK_RUNNER_STATE_DIR "tmp/odkrun"
+
+/* Lock held (shared) by every command running in the repository. */
+#define ODK_RUNNER_REPO_LOCK ODK_RUNNER_STATE_DIR "/repository.lock"
+
+/* Lock held (shared) by every command using a cache shared between
+ * repositories, within the directory of that cache. */
+#define ODK_RUNNER_CACHE_LOCK ".odkrun.lock"
+
+/* A lock on a given invocation within a repository. */
+typedef struct odk_run_lock {
+    int     fd;
+    char   *base;
+    int     saved_stdout;
+    int     saved_stderr;
+    long    tee_pid;
+    char    run_id[32];
+} odk_run_lock_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int
+odk_lock_acquire(odk_run_lock_t *, odk_run_config_t *, char **);
+
+int
+odk_lock_attach(odk_run_lock_t *, int *);
+
+void
+odk_lock_release(odk_run_lock_t *, int);
+
+int
+odk_repository_lock(int);
+
+int
+odk_cache_lock(const char *, int);
+
+void
+odk_unlock(int);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !ICP20261018_RUNLOCK_H */
@@ -66,7 +66,16 @@ odk_init_config(odk_run_config_t *cfg)
     cfg->java_opts = NULL;
     cfg->n_java_opts = 0;
     cfg->oak_cache_directory = DEFAULT_OAK_CACHE;
+    cfg->prefetch_patterns = NULL;
+    cfg->n_prefetch_patterns = 0;
+    cfg->priority = ODK_PRIORITY_NORMAL;
+    cfg->network = ODK_NETWORK_DEFAULT;
+    cfg->network_rules = NULL;
+    cfg->n_network_rules = 0;
+    cfg->container_id_file = NULL;
     cfg->flags = 0;
+    cfg->mr.items = NULL;
+    cfg->mr.count = 0;
 }
 
 /**
@@ -98,6 +107,20 @@ odk_free_config(odk_run_config_t *cfg)
         cfg->java_opts = NULL;
         cfg->n_java_opts = 0;
     }
+
+    if ( cfg->prefetch_patterns ) {
+        free(cfg->prefetch_patterns);
+        cfg->prefetch_patterns = NULL;
+        cfg->n_prefetch_patterns = 0;
+    }
+
+    if ( cfg->network_rules ) {
+        free(cfg->network_rules);
+        cfg->network_rules = NULL;
+        cfg->n_network_rules = 0;
+    }
+
+    mr_free(&(cfg->mr));
 }
 
 /**
@@ -149,6 +172,192 @@ odk_set_oak_cache_directory(odk_run_config_t *cfg, const char *dir, int fgs)
         cfg->oak_cache_directory = dir;
 }
 
+/**
+ * Sets the scheduling priority of the command to run.
+ *
+ * @param cfg  The ODK configuration to update.
+ * @param name The name of the priority class: "background", "normal",
+ *             or "high".
+ * @param fgs  If ODK_NO_OVERWRITE is set, only set the priority if it
+ *             has not been explicitly set before.
+ *
+ * @return 0 if successful, or -1 if the priority class is invalid.
+ */
+int
+odk_set_priority(odk_run_config_t *cfg, const char *name, int fgs)
+{
+    int priority;
+
+    assert(cfg != NULL);
+    assert(name != NULL);
+
+    if ( strcmp(name, "background") == 0 )
+        priority = ODK_PRIORITY_BACKGROUND;
+    else if ( strcmp(name, "normal") == 0 )
+        priority = ODK_PRIORITY_NORMAL;
+    else if ( strcmp(name, "high") == 0 )
+        priority = ODK_PRIORITY_HIGH;
+    else
+        return -1;
+
+    if ( (cfg->flags & ODK_FLAG_PRIORITYSET) == 0 || (fgs & ODK_NO_OVERWRITE) == 0 ) {
+        cfg->priority = priority;
+        cfg->flags |= ODK_FLAG_PRIORITYSET;
+    }
+
+    return 0;
+}
+
+static const char *network_names[] = { "default", "none", "bridge", "host" };
+
+/**
+ * Sets the network mode of the container.
+ *
+ * @param cfg  The ODK configuration to update.
+ * @param name The name of the network mode: "host", "none", or
+ *             "bridge".
+ * @param fgs  If ODK_NO_OVERWRITE is set, only set the mode if it has
+ *             not been explicitly set before.
+ *
+ * @return 0 if successful, or -1 if the network mode is invalid.
+ */
+int
+odk_set_network(odk_run_config_t *cfg, const char *name, int fgs)
+{
+    int network = -1;
+
+    assert(cfg != NULL);
+    assert(name != NULL);
+
+    for ( int i = ODK_NETWORK_NONE; i <= ODK_NETWORK_HOST; i++ )
+        if ( strcmp(name, network_names[i]) == 0 )
+            network = i;
+
+    if ( network == -1 )
+        return -1;
+
+    if ( (cfg->flags & ODK_FLAG_NETWORKSET) == 0 || (fgs & ODK_NO_OVERWRITE) == 0 ) {
+        cfg->network = network;
+        cfg->flags |= ODK_FLAG_NETWORKSET;
+    }
+
+    return 0;
+}
+
+/**
+ * Gets the name of a network mode.
+ *
+ * @param network One of the ODK_NETWORK_* constants.
+ *
+ * @return The name of the mode, as accepted by odk_set_network (or
+ *         "default" for ODK_NETWORK_DEFAULT).
+ */
+const char *
+odk_get_network_name(int network)
+{
+    assert(network >= ODK_NETWORK_DEFAULT && network <= ODK_NETWORK_HOST);
+
+    return network_names[network];
+}
+
+/**
+ * Declares the network mode needed by a make target.
+ *
+ * @param cfg     The ODK configuration to update.
+ * @param target  The name of the target. It may end with a '*' to
+ *                match all targets starting with the same prefix. The
+ *                pointer must remain valid for the lifetime of the
+ *                configuration.
+ * @param network ODK_NETWORK_NONE for a target that does not need any
+ *                network access, or ODK_NETWORK_HOST for a target that
+ *                downloads a lot of data.
+ */
+void
+odk_add_network_rule(odk_run_config_t *cfg, const char *target, int network)
+{
+    assert(cfg != NULL);
+    assert(target != NULL);
+
+    if ( cfg->n_network_rules % 10 == 0 )
+        cfg->network_rules = xrealloc(cfg->network_rules, sizeof(odk_network_rule_t) * (cfg->n_network_rules + 10));
+
+    cfg->network_rules[cfg->n_network_rules].target = target;
+    cfg->network_rules[cfg->n_network_rules++].network = network;
+}
+
+/* Gets the network mode declared for a given target. */
+static int
+get_target_network(odk_run_config_t *cfg, const char *target)
+{
+    for ( size_t i = 0; i < cfg->n_network_rules; i++ ) {
+        const char *rule = cfg->network_rules[i].target;
+        size_t len = strlen(rule);
+
+        if ( len > 0 && rule[len - 1] == '*' ) {
+            if ( strncmp(rule, target, len - 1) == 0 )
+                return cfg->network_rules[i].network;
+        } else if ( strcmp(rule, target) == 0 )
+            return cfg->network_rules[i].network;
+    }
+
+    return ODK_NETWORK_DEFAULT;
+}
+
+/**
+ * Automatically selects the network mode for a make command, from the
+ * modes declared for its targets. The container gets no network if
+ * all the targets are declared offline, and the host network if any
+ * target is declared as needing it. Nothing is done if the network
+ * mode has been explicitly set.
+ *
+ * @param cfg     The ODK configuration to update.
+ * @param command The command to run.
+ *
+ * @return 1 if a network mode has been selected, otherwise 0.
+ */
+int
+odk_select_network(odk_run_config_t *cfg, char **command)
+{
+    int network = -1, n_targets = 0;
+
+    assert(cfg != NULL);
+    assert(command != NULL);
+
+    if ( (cfg->flags & ODK_FLAG_NETWORKSET) || cfg->n_network_rules == 0 )
+        return 0;
+
+    if ( ! command[0] || strcmp(command[0], "make") != 0 )
+        return 0;
+
+    for ( char **arg = &command[1]; *arg; arg++ ) {
+        int target_network;
+
+        if ( **arg == '-' ) {
+            /* Skip the arguments of the options that take one. */
+            if ( (*arg)[1] != '\0' && strchr("CfIoW", (*arg)[1]) && (*arg)[2] == '\0' && *(arg + 1) )
+                arg++;
+            continue;
+        }
+        if ( strchr(*arg, '=') || strspn(*arg, "0123456789") == strlen(*arg) )
+            continue;   /* Variable assignment, or argument of -j/-l */
+
+        n_targets += 1;
+        target_network = get_target_network(cfg, *arg);
+        if ( target_network == ODK_NETWORK_HOST )
+            network = ODK_NETWORK_HOST;
+        else if ( target_network == ODK_NETWORK_NONE && network == -1 )
+            network = ODK_NETWORK_NONE;
+        else if ( target_network == ODK_NETWORK_DEFAULT && network != ODK_NETWORK_HOST )
+            network = ODK_NETWORK_DEFAULT;
+    }
+
+    if ( n_targets == 0 || network <= ODK_NETWORK_DEFAULT )
+        return 0;
+
+    cfg->network = network;
+    return 1;
+}
+
 /**
  * Adds a new binding to the configuration. If a binding with the same
  * host-side path already exists, that binding is updated to point to
@@ -281,6 +490,40 @@ odk_add_java_opt(odk_run_config_t *cfg, const char *option, int flags)
     add_var(&(cfg->java_opts), &(cfg->n_java_opts), option, NULL, flags);
 }
 
+/**
+ * Gets the maximal Java heap size set by the -Xmx option.
+ *
+ * @param cfg The ODK configuration.
+ *
+ * @return The heap size in bytes, or 0 if no valid -Xmx option has been
+ *         set.
+ */
+unsigned long long
+odk_get_java_max_heap(odk_run_config_t *cfg)
+{
+    assert(cfg != NULL);
+
+    for ( size_t i = 0; i < cfg->n_java_opts; i++ ) {
+        unsigned long long amount;
+        char unit = '\0';
+
+        if ( strncmp(cfg->java_opts[i].name, "-Xmx", 4) != 0 )
+            continue;
+
+        if ( sscanf(cfg->java_opts[i].name + 4, "%llu%c", &amount, &unit) < 1 )
+            return 0;
+
+        switch ( unit ) {
+        case 'k': case 'K': return amount * 1024;
+        case 'm': case 'M': return amount * 1024 * 1024;
+        case 'g': case 'G': return amount * 1024 * 1024 * 1024;
+        default:            return amount;
+        }
+    }
+
+    return 0;
+}
+
 /**
  * Adds a Java system property to the configuration. If the property
  * already exists, the previous value is updated.
@@ -303,6 +546,30 @@ odk_add_java_property(odk_run_config_t *cfg, const char *name, const char *value
     add_var(&(cfg->java_opts), &(cfg->n_java_opts), name, value, flags);
 }
 
+/**
+ * Adds a pattern matching files to prefetch before running a command.
+ *
+ * @param cfg     The ODK configuration to update.
+ * @param pattern A glob pattern, relative to the current directory.
+ *                The pointer must remain valid for the lifetime of the
+ *                configuration.
+ */
+void
+odk_add_prefetch_pattern(odk_run_config_t *cfg, const char *pattern)
+{
+    assert(cfg != NULL);
+    assert(pattern != NULL);
+
+    for ( unsigned i = 0; i < cfg->n_prefetch_patterns; i++ )
+        if ( strcmp(cfg->prefetch_patterns[i], pattern) == 0 )
+            return;
+
+    if ( cfg->n_prefetch_patterns % 10 == 0 )
+        cfg->prefetch_patterns = xrealloc(cfg->prefetch_patterns, sizeof(char *) * (cfg->n_prefetch_patterns + 10));
+
+    cfg->prefetch_patterns[cfg->n_prefetch_patterns++] = pattern;
+}
+
 /**
  * Compiles all Java options and properties into a string of command
  * line arguments suitable to be passed to a Java virtual machine.
@@ -312,8 +579,8 @@ odk_add_java_property(odk_run_config_t *cfg, const char *name, const char *value
  *               configuration as environment variables.
  *
  * @return A newly allocated buffer containing all the Java command
- *         line arguments. If to_env is true, then that buffer must not
- *         be freed for the lifetime of the configuration.
+ *         line arguments. If to_env is true, then that buffer belongs
+ *         to the configuration and must not be freed by the caller.
  */
 char *
 odk_make_java_args(odk_run_config_t *cfg, int to_env)
@@ -348,6 +615,7 @@ odk_make_java_args(odk_run_config_t *cfg, int to_env)
     }
 
     if ( to_env ) {
+        mr_register(&(cfg->mr), buffer, 0);
         odk_add_env_var(cfg, "JAVA_OPTS", buffer, 0);
         odk_add_env_var(cfg, "ROBOT_JAVA_ARGS", buffer, 0);
     }
@@ -33,6 +33,8 @@
 
 #include <stdlib.h>
 
+#include <memreg.h>
+
 typedef struct odk_bind_config {
     const char *host_directory;
     const char *container_directory;
@@ -43,6 +45,11 @@ typedef struct odk_var {
     const char *value;
 } odk_var_t;
 
+typedef struct odk_network_rule {
+    const char *target;
+    int         network;
+} odk_network_rule_t;
+
 /* Backend-independant ODK configuration. */
 typedef struct odk_run_config {
     const char         *image_name;
@@ -55,17 +62,43 @@ typedef struct odk_run_config {
     odk_var_t          *java_opts;
     size_t              n_java_opts;
     const char         *oak_cache_directory;
+    const char        **prefetch_patterns;
+    size_t              n_prefetch_patterns;
+    int                 priority;
+    int                 network;
+    odk_network_rule_t *network_rules;
+    size_t              n_network_rules;
+    const char         *container_id_file;
     unsigned            flags;
+    mem_registry_t      mr;
 } odk_run_config_t;
 
 #define ODK_FLAG_TIMEDEBUG  0x0001
 #define ODK_FLAG_RUNASROOT  0x0002
 #define ODK_FLAG_SEEDMODE   0x0004
+#define ODK_FLAG_DEDUP      0x0008
+#define ODK_FLAG_PULLIMAGE  0x0010
+#define ODK_FLAG_SPARQLSTORE 0x0020
+#define ODK_FLAG_DIRECTUSER 0x0040
+#define ODK_FLAG_OAKSERVER  0x0080
+#define ODK_FLAG_CHECKPOINT 0x0100
+#define ODK_FLAG_PRIORITYSET 0x1000
 #define ODK_FLAG_JAVAMEMSET 0x2000
 #define ODK_FLAG_INODKREPO  0x4000
+#define ODK_FLAG_NETWORKSET 0x8000
+#define ODK_FLAG_SEEDBATCH  0x10000
 
 #define ODK_NO_OVERWRITE    0x0001
 
+#define ODK_PRIORITY_NORMAL     0
+#define ODK_PRIORITY_BACKGROUND 1
+#define ODK_PRIORITY_HIGH       2
+
+#define ODK_NETWORK_DEFAULT     0
+#define ODK_NETWORK_NONE        1
+#define ODK_NETWORK_BRIDGE      2
+#define ODK_NETWORK_HOST        3
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -85,6 +118,21 @@ odk_set_image_tag(odk_run_config_t *, const char *, int);
 void
 odk_set_oak_cache_directory(odk_run_config_t *, const char *, int);
 
+int
+odk_set_priority(odk_run_config_t *, const char *, int);
+
+int
+odk_set_network(odk_run_config_t *, const char *, int);
+
+const char *
+odk_get_network_name(int);
+
+void
+odk_add_network_rule(odk_run_config_t *, const char *, int);
+
+int
+odk_select_network(odk_run_config_t *, char **);
+
 int
 odk_add_binding(odk_run_config_t *, const char *, const char *, int);
 
@@ -94,9 +142,15 @@ odk_add_env_var(odk_run_config_t *, const char *, const char *, int);
 void
 odk_add_java_opt(odk_run_config_t *, const char *, int);
 
+unsigned long long
+odk_get_java_max_heap(odk_run_config_t *);
+
 void
 odk_add_java_property(odk_run_config_t *, const char *, const char *, int);
 
+void
+odk_add_prefetch_pattern(odk_run_config_t *, const char *);
+
 char *
 odk_make_java_args(odk_run_config_t *, int);
 
@@ -0,0 +1,214 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "shims.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if !defined(ODK_RUNNER_WINDOWS)
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include <xmem.h>
+
+#include "util.h"
+#include "runlock.h"
+
+/*
+ * Shims are small shell scripts that are installed in a directory
+ * (under the runner's state directory, so that they are visible from
+ * within the container) which is put at the front of the PATH of the
+ * command, so that they get called instead of the actual programs
+ * they are named after. They allow the runner to alter the behaviour
+ * of some tools without having to modify the image.
+ *
+ * Each invocation of the runner gets its own shims directory, so that
+ * concurrent invocations with different options do not interfere.
+ */
+
+/* Sets PATH and executes the actual command. */
+static const char *shims_prelude = "PATH=\"$0:$PATH\"; export PATH; exec \"$@\"";
+
+/**
+ * Initialises a set of shims.
+ *
+ * @param shims   The set of shims to initialise.
+ * @param cfg     The ODK configuration; the working directory must have
+ *                been set already.
+ * @param backend The backend that will run the command.
+ */
+void
+odk_shims_init(odk_shims_t *shims, odk_run_config_t *cfg, odk_backend_t *backend)
+{
+    shims->count = 0;
+    shims->directory = NULL;
+    shims->container_directory = NULL;
+
+#if !defined(ODK_RUNNER_WINDOWS)
+    xasprintf(&shims->directory, ODK_RUNNER_STATE_DIR "/shims-%ld", (long)getpid());
+    if ( strcmp(backend->info.name, "native") != 0 )
+        xasprintf(&shims->container_directory, "%s/%s",
+                  cfg->work_directory ? cfg->work_directory : "/work", shims->directory);
+#else
+    (void) cfg;
+    (void) backend;
+#endif
+}
+
+/**
+ * Adds a shim to a set.
+ *
+ * @param shims  The set of shims to update.
+ * @param name   The name of the program to replace.
+ * @param script The Bourne shell script to run instead of the program,
+ *               unless it starts with its own '#!' line.
+ *
+ * @return 0 if successful, or -1 if an error occured (check errno for
+ *         details).
+ */
+int
+odk_shims_add(odk_shims_t *shims, const char *name, const char *script)
+{
+#if defined(ODK_RUNNER_WINDOWS)
+    (void) shims;
+    (void) name;
+    (void) script;
+    errno = ENOSYS;
+    return -1;
+#else
+    FILE *f;
+    char *path;
+    int ret = 0;
+
+    if ( shims->count == 0 ) {
+        if ( create_directory(shims->directory) == -1 )
+            return -1;
+
+        if ( ! shims->container_directory ) {
+            if ( ! (shims->container_directory = realpath(shims->directory, NULL)) )
+                return -1;
+        }
+    }
+
+    xasprintf(&path, "%s/%s", shims->directory, name);
+    if ( (f = fopen(path, "w")) ) {
+        fprintf(f, "%s%s", strncmp(script, "#!", 2) == 0 ? "" : "#!/bin/sh\n", script);
+        if ( fclose(f) == EOF || chmod(path, 0755) == -1 )
+            ret = -1;
+    } else
+        ret = -1;
+    free(path);
+
+    if ( ret == 0 )
+        shims->count += 1;
+
+    return ret;
+#endif
+}
+
+/**
+ * Prepares a command to run with a set of shims.
+ *
+ * @param shims   The set of shims to use.
+ * @param command The command to run.
+ *
+ * @return The command wrapped so that the shims take precedence, or
+ *         the original command if there are no shims. The returned
+ *         array is not owned by the caller.
+ */
+char **
+odk_shims_wrap(odk_shims_t *shims, char **command)
+{
+    char **wrapped, **cursor;
+    size_t n = 5, i = 0;    /* sh -c prelude $0 ... NULL */
+
+    if ( shims->count == 0 )
+        return command;
+
+    for ( cursor = command; *cursor; cursor++ )
+        n += 1;
+
+    wrapped = mr_alloc(NULL, sizeof(char *) * n);
+    wrapped[i++] = "sh";
+    wrapped[i++] = "-c";
+    wrapped[i++] = (char *)shims_prelude;
+    wrapped[i++] = shims->container_directory;
+    for ( cursor = command; *cursor; cursor++ )
+        wrapped[i++] = *cursor;
+    wrapped[i] = NULL;
+
+    return wrapped;
+}
+
+/**
+ * Removes all the shims of a set.
+ *
+ * @param shims The set of shims to remove.
+ */
+void
+odk_shims_cleanup(odk_shims_t *shims)
+{
+#if !defined(ODK_RUNNER_WINDOWS)
+    if ( shims->count > 0 ) {
+        DIR *dir;
+        struct dirent *entry;
+
+        if ( (dir = opendir(shims->directory)) ) {
+            while ( (entry = readdir(dir)) ) {
+                char *path;
+
+                if ( entry->d_name[0] == '.' )
+                    continue;
+
+                /* Shims may leave state directories behind. */
+                xasprintf(&path, "%s/%s", shims->directory, entry->d_name);
+                if ( unlink(path) == -1 )
+                    rmdir(path);
+                free(path);
+            }
+            closedir(dir);
+        }
+        rmdir(shims->directory);
+    }
+#endif
+
+    free(shims->directory);
+    free(shims->container_directory);
+    shims->count = 0;
+}
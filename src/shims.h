@@ -0,0 +1,65 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ICP20261018_SHIMS_H
+#define ICP20261018_SHIMS_H
+
+#include "runner.h"
+#include "backend.h"
+
+/* A set of scripts that take precedence over the programs of the same
+ * name when running a command. */
+typedef struct odk_shims {
+    char   *directory;              /* Host directory */
+    char   *container_directory;    /* Same, as seen by the command */
+    size_t  count;
+} odk_shims_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void
+odk_shims_init(odk_shims_t *, odk_run_config_t *, odk_backend_t *);
+
+int
+odk_shims_add(odk_shims_t *, const char *, const char *);
+
+char **
+odk_shims_wrap(odk_shims_t *, char **);
+
+void
+odk_shims_cleanup(odk_shims_t *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !ICP20261018_SHIMS_H */
@@ -0,0 +1,190 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "sparql.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Persistent SPARQL store.
+ *
+ * ROBOT loads the entire ontology into an in-memory model for every
+ * single 'query' or 'verify' command, which is what most QC checks
+ * use. When the store is enabled, a 'robot' shim answers the simplest
+ * forms of these commands (a single RDF/XML or Turtle input, SELECT
+ * queries, CSV or TSV output) from a TDB2 database instead. There is
+ * one database per input file, under ODK_SPARQL_STORE_DIR, which is
+ * only reloaded when the contents of the file change, so that each
+ * version of a file is parsed only once no matter how many queries
+ * are run against it. Anything the shim does not understand is passed
+ * unmodified to the real ROBOT.
+ */
+
+static const char *robot_shim = "\
+shims=$(cd \"$(dirname \"$0\")\" && pwd)\n\
+store=$(dirname \"$shims\")/sparql\n\
+PATH=$(printf ':%s:' \"$PATH\" | sed \"s|:$shims:|:|g; s|^:||; s|:$||\")\n\
+JVM_ARGS=${JVM_ARGS:-$ROBOT_JAVA_ARGS}\n\
+export PATH JVM_ARGS\n\
+\n\
+parse() {\n\
+    cmd= input= query= output= queries= outdir= format=\n\
+    while [ $# -gt 0 ]; do\n\
+        case $1 in\n\
+        --catalog) shift ;;\n\
+        query|verify) [ -z \"$cmd\" ] || return 1; cmd=$1 ;;\n\
+        -i|--input) input=$2; shift ;;\n\
+        --query) [ $# -ge 3 ] && [ -z \"$query\" ] || return 1; query=$2; output=$3; shift 2 ;;\n\
+        --queries)\n\
+            while [ $# -gt 1 ]; do\n\
+                case $2 in -*) break ;; esac\n\
+                queries=\"$queries $2\"; shift\n\
+            done ;;\n\
+        -O|--output-dir) outdir=$2; shift ;;\n\
+        -f|--format) format=$2; shift ;;\n\
+        --use-graphs) [ \"$2\" = false ] || return 1; shift ;;\n\
+        *) return 1 ;;\n\
+        esac\n\
+        shift\n\
+    done\n\
+    case $format in ''|csv|tsv) ;; *) return 1 ;; esac\n\
+    [ -n \"$cmd\" ] && [ -f \"$input\" ] || return 1\n\
+    case $cmd in\n\
+    query) [ -n \"$query\" ] || [ -n \"$outdir\" ] ;;\n\
+    verify) [ -z \"$query\" ] && [ -n \"$queries\" ] && [ -n \"$outdir\" ] ;;\n\
+    esac\n\
+}\n\
+\n\
+load() {\n\
+    case $1 in\n\
+    *.ttl) ;;\n\
+    *.owl|*.rdf) head -c 2048 \"$1\" | grep -q '<rdf:RDF' || return 1 ;;\n\
+    *) return 1 ;;\n\
+    esac\n\
+    command -v tdb2.tdbloader > /dev/null && mkdir -p \"$store\" || return 1\n\
+\n\
+    db=$store/$(printf '%s' \"$(cd \"$(dirname \"$1\")\" && pwd)/${1##*/}\" | cksum | cut -d' ' -f1)\n\
+    sum=$(cksum < \"$1\" | tr ' ' -)\n\
+    status=hit\n\
+    if [ ! -d \"$db-$sum\" ]; then\n\
+        status=load\n\
+        tdb2.tdbloader --loc \"$db-$sum.$$\" \"$1\" > /dev/null 2>&1 || { rm -rf \"$db-$sum.$$\"; return 1; }\n\
+        if ln -sn \"${db##*/}-$sum.$$\" \"$db-$sum\" 2> /dev/null; then\n\
+            for old in \"$db\"-*; do\n\
+                case $old in \"$db-$sum\"|\"$db-$sum.$$\") ;; *) rm -rf \"$old\" ;; esac\n\
+            done\n\
+        else\n\
+            rm -rf \"$db-$sum.$$\"\n\
+        fi\n\
+    fi\n\
+    db=$db-$sum\n\
+}\n\
+\n\
+run() {\n\
+    tdb2.tdbquery --loc \"$db\" --query \"$1\" --results \"$(echo \"$3\" | tr a-z A-Z)\" > \"$2.$$\" 2> /dev/null \\\n\
+        && mv \"$2.$$\" \"$2\" || { rm -f \"$2.$$\"; return 1; }\n\
+}\n\
+\n\
+answer() {\n\
+    rc=0\n\
+    if [ -n \"$query\" ]; then\n\
+        fmt=${format:-${output##*.}}\n\
+        case $fmt in csv|tsv) ;; *) return 1 ;; esac\n\
+        run \"$query\" \"$output\" \"$fmt\" || return 1\n\
+    fi\n\
+    for q in $queries; do\n\
+        out=$outdir/$(basename \"${q%.*}\").${format:-csv}\n\
+        run \"$q\" \"$out\" \"${format:-csv}\" || return 1\n\
+        if [ $cmd = verify ]; then\n\
+            n=$(($(wc -l < \"$out\") - 1))\n\
+            if [ $n -gt 0 ]; then\n\
+                echo \"Rule $q: $n violation(s)\"\n\
+                cat \"$out\"\n\
+                rc=1\n\
+            else\n\
+                echo \"Rule $q: 0 violation(s)\"\n\
+            fi\n\
+        fi\n\
+    done\n\
+}\n\
+\n\
+if parse \"$@\" && load \"$input\" && answer; then\n\
+    echo $status >> \"$store/stats\"\n\
+    exit $rc\n\
+fi\n\
+mkdir -p \"$store\" && echo fallback >> \"$store/stats\"\n\
+exec robot \"$@\"\n\
+";
+
+/**
+ * Enables the SPARQL store for the next command.
+ *
+ * @param shims The set of shims to use for the command.
+ *
+ * @return 0 if successful, or -1 if an error occured (check errno for
+ *         details).
+ */
+int
+odk_sparql_store_enable(odk_shims_t *shims)
+{
+    return odk_shims_add(shims, "robot", robot_shim);
+}
+
+/**
+ * Gets the cumulative usage counters of the SPARQL store.
+ *
+ * @param stats The structure to fill. All counters are set to zero if
+ *              the store has never been used.
+ */
+void
+odk_sparql_store_get_stats(odk_sparql_stats_t *stats)
+{
+    FILE *f;
+    char line[16];
+
+    memset(stats, 0, sizeof(odk_sparql_stats_t));
+
+    if ( (f = fopen(ODK_SPARQL_STORE_DIR "/stats", "r")) ) {
+        while ( fgets(line, sizeof(line), f) ) {
+            if ( strcmp(line, "hit\n") == 0 )
+                stats->hits += 1;
+            else if ( strcmp(line, "load\n") == 0 )
+                stats->loads += 1;
+            else if ( strcmp(line, "fallback\n") == 0 )
+                stats->fallbacks += 1;
+        }
+        fclose(f);
+    }
+}
@@ -0,0 +1,255 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "toolchain.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <memreg.h>
+
+#include "procutil.h"
+#include "util.h"
+
+/*
+ * A native toolchain is the subset of a ODK image needed to run the
+ * ODK workflows outside of a container: the /tools directory (ROBOT,
+ * odk.py, and the other Java tools), /usr/local (the Python packages
+ * and their scripts), and the Java runtime. It is extracted from the
+ * image into the user's cache directory, in a subdirectory named after
+ * the image and its tag, so that several versions can coexist.
+ */
+
+/*
+ * Shell script to extract a toolchain from an image. Expects the image
+ * reference and the destination directory as arguments. The toolchain
+ * is first extracted into a temporary directory, so that an existing
+ * toolchain is only replaced once the new one is complete.
+ */
+static const char *install_script = "\
+set -e\n\
+image=$1\n\
+dest=$2\n\
+tmp=$dest.tmp.$$\n\
+cid=\n\
+trap '[ -z \"$cid\" ] || docker rm -f \"$cid\" > /dev/null 2>&1; rm -rf \"$tmp\" \"$tmp.err\" \"$tmp.failed\"' EXIT\n\
+trap 'exit 1' INT TERM\n\
+mkdir -p \"$tmp\"\n\
+echo \"Extracting toolchain from $image...\"\n\
+cid=$(docker create \"$image\" true)\n\
+# There is no pipefail in sh, so the status of the export is recorded\n\
+# separately. Only the optional parts may be missing from the archive.\n\
+rc=0\n\
+{ docker export \"$cid\" || touch \"$tmp.failed\"; } | tar -x -C \"$tmp\" --wildcards 'tools/*' \\\n\
+  'usr/local/*' 'usr/lib/jvm/*' 'etc/java-*' 'etc/ssl/certs/java/*' 2> \"$tmp.err\" || rc=$?\n\
+if [ -e \"$tmp.failed\" ]; then\n\
+  echo \"Cannot export the contents of $image\" >&2\n\
+  exit 1\n\
+fi\n\
+if [ $rc -ne 0 ] && grep -v -F -e 'usr/local/*: Not found in archive' \\\n\
+    -e 'etc/java-*: Not found in archive' -e 'etc/ssl/certs/java/*: Not found in archive' \\\n\
+    -e 'Exiting with failure status due to previous errors' \"$tmp.err\" | grep . >&2; then\n\
+  echo \"Cannot extract toolchain from $image\" >&2\n\
+  exit 1\n\
+fi\n\
+# Absolute symlinks still point into the host at this stage, so only\n\
+# real directories are considered, and bin/java is not followed.\n\
+jdk=\n\
+for dir in \"$tmp\"/usr/lib/jvm/*; do\n\
+  if [ -d \"$dir\" ] && [ ! -L \"$dir\" ] && { [ -e \"$dir/bin/java\" ] || [ -L \"$dir/bin/java\" ]; }; then\n\
+    jdk=${dir#$tmp/}\n\
+    break\n\
+  fi\n\
+done\n\
+if [ -z \"$jdk\" ]; then\n\
+  echo \"No Java runtime found in $image\" >&2\n\
+  exit 1\n\
+fi\n\
+ln -s \"$jdk\" \"$tmp/jdk\"\n\
+python=$(ls -d \"$tmp\"/usr/local/lib/python3*/dist-packages \\\n\
+  \"$tmp\"/usr/local/lib/python3*/site-packages 2> /dev/null | head -n 1)\n\
+if [ -n \"$python\" ]; then\n\
+  python=${python#$tmp/}\n\
+  ln -s \"$python\" \"$tmp/python\"\n\
+  version=${python#usr/local/lib/python}\n\
+  version=${version%%/*}\n\
+  host=$(python3 -c 'import sys; print(\"%d.%d\" % sys.version_info[:2])' 2> /dev/null || true)\n\
+  [ \"$version\" = \"$host\" ] || \\\n\
+    echo \"Warning: the Python tools need Python $version, found ${host:-none}\" >&2\n\
+fi\n\
+find \"$tmp\" -type l | while read -r link; do\n\
+  target=$(readlink \"$link\")\n\
+  case \"$target\" in\n\
+  /*) ln -sfn \"$dest$target\" \"$link\" ;;\n\
+  esac\n\
+done\n\
+echo \"$image\" > \"$tmp/image\"\n\
+rm -rf \"$dest.old\"\n\
+[ ! -d \"$dest\" ] || mv \"$dest\" \"$dest.old\"\n\
+mv \"$tmp\" \"$dest\"\n\
+rm -rf \"$dest.old\"\n\
+echo \"Toolchain installed in $dest\"\n\
+";
+
+/**
+ * Gets the directory containing the native toolchains.
+ *
+ * @param cfg The ODK configuration.
+ *
+ * @return The path to the directory (allocated on the configuration's
+ *         registry), or NULL if the user's home directory is unknown.
+ */
+char *
+odk_toolchain_get_cache_directory(odk_run_config_t *cfg)
+{
+    char *dir = NULL;
+    char *base;
+
+#if defined(ODK_RUNNER_LINUX)
+    if ( (base = getenv("XDG_CACHE_HOME")) )
+        dir = mr_sprintf(&(cfg->mr), "%s/odkrun/native", base);
+    else if ( (base = getenv("HOME")) )
+        dir = mr_sprintf(&(cfg->mr), "%s/.cache/odkrun/native", base);
+#elif defined(ODK_RUNNER_MACOS)
+    if ( (base = getenv("HOME")) )
+        dir = mr_sprintf(&(cfg->mr), "%s/Library/Caches/odkrun/native", base);
+#elif defined(ODK_RUNNER_WINDOWS)
+    if ( (base = getenv("LOCALAPPDATA")) )
+        dir = mr_sprintf(&(cfg->mr), "%s/odkrun/native", base);
+#endif
+
+    return dir;
+}
+
+/**
+ * Gets the directory of the toolchain matching the configured image.
+ *
+ * @param cfg The ODK configuration.
+ *
+ * @return The path to the directory (allocated on the configuration's
+ *         registry), or NULL if the user's home directory is unknown.
+ */
+char *
+odk_toolchain_get_directory(odk_run_config_t *cfg)
+{
+    char *cache, *name;
+
+    if ( ! (cache = odk_toolchain_get_cache_directory(cfg)) )
+        return NULL;
+
+    if ( (name = strrchr(cfg->image_name, '/')) )
+        name += 1;
+    else
+        name = (char *)cfg->image_name;
+
+    return mr_sprintf(&(cfg->mr), "%s/%s-%s", cache, name, cfg->image_tag);
+}
+
+/**
+ * Extracts the toolchain from the configured image into the cache,
+ * replacing any previously installed toolchain for the same image.
+ *
+ * @param cfg The ODK configuration.
+ *
+ * @return 0 if successful, -1 if the extraction could not be started
+ *         or was interrupted (check errno for details), or the
+ *         (positive) exit code of the extraction script.
+ */
+int
+odk_toolchain_install(odk_run_config_t *cfg)
+{
+#if defined(ODK_RUNNER_LINUX)
+    char *argv[7];
+    char *image_qualifier;
+    int ret;
+
+    if ( ! (argv[5] = odk_toolchain_get_directory(cfg)) ) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    image_qualifier = strchr(cfg->image_name, '/') ? "" : "obolibrary/";
+
+    argv[0] = "sh";
+    argv[1] = "-c";
+    argv[2] = (char *)install_script;
+    argv[3] = "odkrun-native-install";
+    argv[4] = mr_sprintf(&(cfg->mr), "%s%s:%s", image_qualifier, cfg->image_name, cfg->image_tag);
+    argv[6] = NULL;
+
+    errno = 0;
+    if ( (ret = spawn_process(argv, NULL)) == -1 && errno == 0 )
+        errno = EINTR;  /* The script was killed by a signal. */
+
+    return ret;
+#else
+    (void) cfg;
+    (void) install_script;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * Makes the toolchain matching the configured image, if it has been
+ * installed, available to the commands run natively.
+ *
+ * @param cfg The ODK configuration to update.
+ *
+ * @return 1 if the toolchain has been set up, 0 if no toolchain is
+ *         installed for the configured image.
+ */
+int
+odk_toolchain_setup(odk_run_config_t *cfg)
+{
+    char *dir, *path;
+
+    if ( ! (dir = odk_toolchain_get_directory(cfg)) )
+        return 0;
+    if ( file_exists(mr_sprintf(&(cfg->mr), "%s/jdk/bin/java", dir)) == -1 )
+        return 0;
+
+    if ( ! (path = getenv("PATH")) )
+        path = "/usr/bin:/bin";
+
+    odk_add_env_var(cfg, "PATH", mr_sprintf(&(cfg->mr), "%s/tools:%s/usr/local/bin:%s/jdk/bin:%s",
+                                            dir, dir, dir, path), 0);
+    odk_add_env_var(cfg, "JAVA_HOME", mr_sprintf(&(cfg->mr), "%s/jdk", dir), 0);
+
+    if ( file_exists(mr_sprintf(&(cfg->mr), "%s/python", dir)) == 0 )
+        odk_add_env_var(cfg, "PYTHONPATH", mr_sprintf(&(cfg->mr), "%s/python", dir), 0);
+
+    return 1;
+}
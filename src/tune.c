@@ -0,0 +1,374 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "tune.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+
+#if !defined(ODK_RUNNER_WINDOWS)
+#include <unistd.h>
+#endif
+
+#include <memreg.h>
+#include <sbuffer.h>
+#include <xmem.h>
+
+#include "util.h"
+#include "procutil.h"
+#include "runconf.h"
+
+/*
+ * Automatic tuning of the parallelism and Java heap size.
+ *
+ * Each trial runs the command through odkrun itself, with the same
+ * global options as the 'tune' invocation, in a fresh copy of the
+ * repository whose run.sh.conf has been amended with the settings
+ * under test -- so that what is measured is exactly what will be used
+ * afterwards. Since every trial is a full build, the search is kept
+ * small:
+ * 1. the number of jobs is doubled from 1 up to the number of CPUs,
+ *    each job getting an equal share of 90% of the memory as heap,
+ *    until it stops improving;
+ * 2. a smaller heap (60% of that share) is tried, since it leaves more
+ *    memory to the page cache;
+ * 3. the parallel garbage collector is tried instead of the default
+ *    one.
+ * A change is only kept if it saves at least 3% of the time, so as not
+ * to chase noise. The resulting configuration is then written to
+ * run.sh.conf.
+ */
+
+#define MIN_HEAP_SIZE   1024    /* In MB */
+#define MIN_GAIN        0.97
+#define MAX_TRIALS      16
+
+/* A configuration to evaluate. */
+typedef struct trial {
+    unsigned        jobs;
+    unsigned long   heap;       /* In MB */
+    int             parallel_gc;
+    int             status;
+    double          time;
+} trial_t;
+
+/* Gets the value of the ODK_JAVA_OPTS setting in run.sh.conf. */
+static char *
+get_java_opts(void)
+{
+    FILE *f;
+    char *line = NULL, *value = NULL;
+    size_t n = 0;
+    ssize_t len;
+
+    if ( (f = fopen(RUNCONF_FILENAME, "r")) ) {
+        while ( ! value && (len = getline(&line, &n, f)) != -1 ) {
+            while ( len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r') )
+                line[--len] = '\0';
+            if ( strncmp(line, "ODK_JAVA_OPTS=", 14) == 0 ) {
+                value = line + 14;
+                len -= 14;
+                if ( len >= 2 && (*value == '"' || *value == '\'') && value[len - 1] == *value ) {
+                    value[len - 1] = '\0';
+                    value += 1;
+                }
+                value = xstrdup(value);
+            }
+        }
+        free(line);
+        fclose(f);
+    }
+
+    return value;
+}
+
+/* Writes the settings of a trial into run.sh.conf, replacing any
+ * previous setting of the number of jobs, heap size, and garbage
+ * collector, but keeping everything else from the original file. */
+static int
+write_run_conf(const char *original, const char *java_opts, trial_t *trial)
+{
+    FILE *in, *out;
+    char *line = NULL, *token, *opts;
+    size_t n = 0;
+    string_buffer_t sb;
+    int ret = 0;
+
+    if ( ! (out = fopen(RUNCONF_FILENAME ".tmp", "w")) )
+        return -1;
+
+    if ( (in = fopen(original, "r")) ) {
+        while ( getline(&line, &n, in) != -1 ) {
+            if ( strncmp(line, "ODK_JAVA_OPTS=", 14) != 0 && strncmp(line, "ODK_JOBS=", 9) != 0 )
+                fputs(line, out);
+        }
+        free(line);
+        fclose(in);
+    }
+
+    sb_init(&sb, 128);
+    sb_addf(&sb, "-Xmx%luM", trial->heap);
+    if ( java_opts ) {
+        opts = xstrdup(java_opts);
+        for ( token = strtok(opts, " "); token; token = strtok(NULL, " ") ) {
+            if ( strncmp(token, "-Xmx", 4) != 0
+                    && ! (strncmp(token, "-XX:+Use", 8) == 0 && strstr(token, "GC")) )
+                sb_addf(&sb, " %s", token);
+        }
+        free(opts);
+    }
+    if ( trial->parallel_gc )
+        sb_add(&sb, " -XX:+UseParallelGC");
+
+    /* The file is also sourced by run.sh, hence the quotes. */
+    fprintf(out, "ODK_JAVA_OPTS=\"%s\"\nODK_JOBS=%u\n", sb_get(&sb), trial->jobs);
+    free(sb.buffer);
+
+    if ( fclose(out) == EOF || rename(RUNCONF_FILENAME ".tmp", RUNCONF_FILENAME) == -1 )
+        ret = -1;
+
+    return ret;
+}
+
+/* Prints the settings of a trial. */
+static void
+print_trial(trial_t *trial, const char *prefix)
+{
+    printf("%s-j%u -Xmx%luM%s: ", prefix, trial->jobs, trial->heap,
+           trial->parallel_gc ? " -XX:+UseParallelGC" : "");
+    if ( trial->status == 0 )
+        printf("%.1f s\n", trial->time);
+    else
+        printf("failed (exit code %d)\n", trial->status);
+    fflush(stdout);
+}
+
+/*
+ * Copies the files of a repository known to Git (tracked files,
+ * including local changes, and untracked files that are not ignored)
+ * to a new directory. Built products, tmp/, mirror/, etc. are thus
+ * left behind, so that the trial has to build everything again, and
+ * we do not spend time copying them. Tracked files that have been
+ * deleted locally are skipped.
+ */
+static const char *copy_script = "\
+set -e\n\
+cd \"$1\"\n\
+git ls-files -z -c -o --exclude-standard > \"$2.files\"\n\
+mkdir \"$2\"\n\
+xargs -0 sh -c 'for f; do if [ -e \"$f\" ] || [ -L \"$f\" ]; then printf \"%s\\0\" \"$f\"; fi; done' sh \\\n\
+  < \"$2.files\" | tar --null -T - -cf - | (cd \"$2\" && tar -xf -)\n\
+";
+
+/* Runs the command in a fresh copy of the repository, with the
+ * settings of the trial. */
+static void
+run_trial(char **argv, const char *java_opts, trial_t *trial)
+{
+    const char *tmpdir = getenv("TMPDIR");
+    char *workspace, *copy, *cwd, *original;
+    odk_process_t proc;
+    odk_run_stats_t stats;
+
+    trial->status = -1;
+    trial->time = 0;
+
+    xasprintf(&workspace, "%s/odkrun-tune-XXXXXX", tmpdir ? tmpdir : "/tmp");
+    if ( ! mkdtemp(workspace) || ! (cwd = realpath(".", NULL)) ) {
+        warn("Cannot create workspace");
+        free(workspace);
+        return;
+    }
+    xasprintf(&copy, "%s/repository", workspace);
+    xasprintf(&original, "%s/" RUNCONF_FILENAME, cwd);
+
+    {
+        char *cp_argv[] = { "sh", "-c", (char *)copy_script, "odkrun-tune-copy", "../..", copy, NULL };
+
+        if ( spawn_process(cp_argv, NULL) != 0 )
+            warnx("Cannot copy repository to %s", copy);
+        else if ( chdir(copy) == -1 || chdir("src/ontology") == -1
+                || write_run_conf(original, java_opts, trial) == -1 )
+            warn("Cannot prepare workspace %s", copy);
+        else if ( start_process(argv, PROCESS_QUIET, &proc) == -1 )
+            warn("Cannot start trial");
+        else {
+            trial->status = wait_process(&proc, &stats);
+            trial->time = stats.wall_time;
+        }
+    }
+
+    if ( chdir(cwd) == -1 )
+        err(EXIT_FAILURE, "Cannot return to %s", cwd);
+
+    {
+        char *rm_argv[] = { "rm", "-rf", workspace, NULL };
+
+        if ( spawn_process(rm_argv, NULL) != 0 )
+            warnx("Cannot remove workspace %s", workspace);
+    }
+
+    free(original);
+    free(cwd);
+    free(copy);
+    free(workspace);
+}
+
+/**
+ * Finds the number of jobs, Java heap size, and garbage collector that
+ * make a command run the fastest, and saves them to run.sh.conf. This
+ * must be called from the src/ontology directory of a ODK repository.
+ *
+ * @param backend   The backend in use.
+ * @param argv      The command line of odkrun; the program name and the
+ *                  global options are used to run the trials.
+ * @param n_options The number of global options in argv (not including
+ *                  the program name).
+ * @param command   The command to tune, as a NULL-terminated array of
+ *                  arguments.
+ *
+ * @return 0 if a configuration has been found and saved, or -1
+ *         otherwise (in which case an error message has been printed).
+ */
+int
+odk_tune(odk_backend_t *backend, char **argv, int n_options, char **command)
+{
+#if defined(ODK_RUNNER_WINDOWS)
+    (void) backend;
+    (void) argv;
+    (void) n_options;
+    (void) command;
+    warnx("Tuning is not supported on this platform");
+    return -1;
+#else
+    trial_t trials[MAX_TRIALS], *best = NULL;
+    size_t n_trials = 0, n_args = 0;
+    unsigned long total_memory, max_jobs;
+    char **trial_argv, *java_opts;
+    mem_registry_t mr = { 0 };
+    int ret = -1;
+
+    total_memory = backend->info.total_memory / (1024 * 1024);
+    max_jobs = backend->info.n_cpus > 0 ? backend->info.n_cpus : 1;
+    if ( total_memory == 0 ) {
+        warnx("Could not get memory information from backend");
+        return -1;
+    }
+    if ( ! *command ) {
+        warnx("No command to tune");
+        return -1;
+    }
+
+    while ( command[n_args] )
+        n_args += 1;
+    trial_argv = mr_alloc(&mr, sizeof(char *) * (n_options + n_args + 2));
+    memcpy(trial_argv, argv, sizeof(char *) * (n_options + 1));
+    memcpy(trial_argv + n_options + 1, command, sizeof(char *) * (n_args + 1));
+
+    /* Trials run from another directory, so a relative program name
+     * must be resolved now. */
+    if ( strchr(argv[0], '/') && ! (trial_argv[0] = mr_register(&mr, realpath(argv[0], NULL), 0)) ) {
+        warn("Cannot find %s", argv[0]);
+        mr_free(&mr);
+        return -1;
+    }
+
+    java_opts = get_java_opts();
+
+    printf("Tuning with the %s backend (%lu CPUs, %lu MB); each trial runs in a fresh copy of the repository.\n",
+           backend->info.name, max_jobs, total_memory);
+
+    /* 1. Number of jobs */
+    for ( unsigned jobs = 1; n_trials < MAX_TRIALS; jobs = jobs * 2 < max_jobs ? jobs * 2 : max_jobs ) {
+        trial_t *trial = &trials[n_trials++];
+
+        trial->jobs = jobs;
+        trial->heap = (total_memory * 9 / 10 / jobs) / 256 * 256;
+        trial->parallel_gc = 0;
+        if ( trial->heap < MIN_HEAP_SIZE ) {
+            n_trials -= 1;
+            break;
+        }
+
+        run_trial(trial_argv, java_opts, trial);
+        print_trial(trial, "");
+        if ( trial->status != 0 || (best && trial->time > best->time * MIN_GAIN) )
+            break;
+        best = trial;
+        if ( jobs == max_jobs )
+            break;
+    }
+
+    /* 2. Smaller heap */
+    if ( best && best->heap * 6 / 10 >= MIN_HEAP_SIZE && n_trials < MAX_TRIALS ) {
+        trial_t *trial = &trials[n_trials++];
+
+        *trial = *best;
+        trial->heap = (best->heap * 6 / 10) / 256 * 256;
+        run_trial(trial_argv, java_opts, trial);
+        print_trial(trial, "");
+        if ( trial->status == 0 && trial->time <= best->time * MIN_GAIN )
+            best = trial;
+    }
+
+    /* 3. Garbage collector */
+    if ( best && n_trials < MAX_TRIALS ) {
+        trial_t *trial = &trials[n_trials++];
+
+        *trial = *best;
+        trial->parallel_gc = 1;
+        run_trial(trial_argv, java_opts, trial);
+        print_trial(trial, "");
+        if ( trial->status == 0 && trial->time <= best->time * MIN_GAIN )
+            best = trial;
+    }
+
+    if ( ! best )
+        warnx("No configuration could run the command successfully");
+    else if ( write_run_conf(RUNCONF_FILENAME, java_opts, best) == -1 )
+        warn("Cannot update " RUNCONF_FILENAME);
+    else {
+        print_trial(best, "Best configuration, saved to " RUNCONF_FILENAME ": ");
+        ret = 0;
+    }
+
+    free(java_opts);
+    mr_free(&mr);
+
+    return ret;
+#endif
+}
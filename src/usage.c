@@ -0,0 +1,842 @@
+/*
+ * ODK Runner
+ * Copyright (C) 2026 Damien Goutte-Gattat
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "usage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(HAVE_PTHREAD_H) && defined(ODK_RUNNER_LINUX)
+#define ODK_USAGE_SUPPORTED
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#endif
+
+#include <xmem.h>
+
+#include "util.h"
+
+/*
+ * Resource usage recording.
+ *
+ * A background thread periodically samples the memory, CPU time, and
+ * block I/O used by the command. With Docker, the command runs in the
+ * cgroup of the container, whose counters are read directly (cgroup v2
+ * only); the cgroup is found from the PID of the container, once its
+ * ID has been written to the file given to 'docker run --cidfile'.
+ * With the other backends, the command runs in processes that descend
+ * from ours, whose counters are summed up from /proc; this includes
+ * the processes that have terminated since the last sample, since the
+ * kernel adds the CPU time and I/O of a process to those of its parent
+ * when it is reaped.
+ *
+ * Each sample is also labelled with the program that used the most
+ * CPU time during the interval (e.g. 'robot reason' rather than just
+ * 'java'), so that the curves can be related to the steps of the
+ * workflow.
+ */
+
+#if defined(ODK_USAGE_SUPPORTED)
+
+#define SVG_WIDTH       960
+#define SVG_LEFT        70
+#define SVG_RIGHT       940
+#define SVG_CHART       180     /* Height of a single chart */
+#define SVG_GAP         50
+
+/* Figures of a process, as read from /proc. */
+typedef struct proc_info {
+    pid_t               pid;
+    pid_t               ppid;
+    unsigned long long  cpu;        /* In microseconds */
+    unsigned long long  cpu_total;  /* Including reaped children */
+    unsigned long       rss;        /* In pages */
+    char                comm[16];
+} proc_info_t;
+
+/* Last known CPU time of a process. */
+typedef struct proc_entry {
+    pid_t               pid;
+    unsigned long long  cpu;
+    int                 seen;
+} proc_entry_t;
+
+/* Cumulative counters for the whole command. */
+typedef struct counters {
+    unsigned long long  cpu;        /* In microseconds */
+    unsigned long long  read;       /* In bytes */
+    unsigned long long  written;    /* In bytes */
+} counters_t;
+
+/* A single point of the time series. */
+typedef struct sample {
+    double          time;       /* Seconds since the start */
+    unsigned long   memory;     /* In kilobytes */
+    double          cpu;        /* In percents of one CPU */
+    unsigned long   read;       /* Kilobytes read during the interval */
+    unsigned long   written;    /* Kilobytes written during the interval */
+    size_t          label;      /* Index into the labels table */
+} sample_t;
+
+/* Private state of the sampling thread. */
+typedef struct recorder_state {
+    FILE           *out;
+    int             stop_pipe[2];
+    int             running;
+    pthread_t       thread;
+    double          start;
+    long            ticks;      /* Clock ticks per second */
+    long            page_size;  /* In kilobytes */
+    char           *cgroup;
+    proc_entry_t   *procs;
+    size_t          n_procs;
+    size_t          max_procs;
+    counters_t      last;
+    double          last_time;
+    sample_t       *samples;
+    size_t          max_samples;
+    char          **labels;
+    size_t          n_labels;
+} recorder_state_t;
+
+/* Reads a small file (such as those in /proc) into a buffer. */
+static ssize_t
+read_small_file(const char *path, char *buffer, size_t len)
+{
+    FILE *f;
+    size_t n;
+
+    if ( ! (f = fopen(path, "r")) )
+        return -1;
+    n = fread(buffer, 1, len - 1, f);
+    fclose(f);
+    buffer[n] = '\0';
+
+    return n;
+}
+
+/* Gets the value associated with a key in files such as memory.stat
+ * or /proc/PID/io, made of "key value" lines. */
+static unsigned long long
+get_keyed_value(const char *buffer, const char *key)
+{
+    size_t len = strlen(key);
+
+    for ( const char *p = buffer; p; p = strchr(p, '\n') ) {
+        if ( *p == '\n' )
+            p++;
+        if ( strncmp(p, key, len) == 0 && p[len] == ' ' )
+            return strtoull(p + len + 1, NULL, 10);
+    }
+
+    return 0;
+}
+
+/* Reads the figures of a process. */
+static int
+read_proc_info(recorder_state_t *rs, pid_t pid, proc_info_t *info)
+{
+    char path[64], buffer[1024], *open, *close;
+    unsigned long utime, stime;
+    long cutime, cstime, rss;
+    int ppid;
+    size_t len;
+
+    snprintf(path, sizeof(path), "/proc/%ld/stat", (long)pid);
+    if ( read_small_file(path, buffer, sizeof(buffer)) <= 0 )
+        return -1;
+
+    /* The command name may contain spaces and parentheses. */
+    if ( ! (open = strchr(buffer, '(')) || ! (close = strrchr(buffer, ')')) || close < open )
+        return -1;
+    if ( sscanf(close + 2, "%*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu "
+                "%ld %ld %*d %*d %*d %*d %*u %*u %ld", &ppid, &utime, &stime, &cutime, &cstime, &rss) != 6 )
+        return -1;
+
+    len = close - open - 1;
+    if ( len >= sizeof(info->comm) )
+        len = sizeof(info->comm) - 1;
+    memcpy(info->comm, open + 1, len);
+    info->comm[len] = '\0';
+    info->pid = pid;
+    info->ppid = ppid;
+    info->cpu = (unsigned long long)(utime + stime) * 1000000 / rs->ticks;
+    info->cpu_total = info->cpu + (unsigned long long)(cutime + cstime) * 1000000 / rs->ticks;
+    info->rss = rss > 0 ? rss : 0;
+
+    return 0;
+}
+
+static int
+compare_pids(const void *a, const void *b)
+{
+    const proc_info_t *p1 = a, *p2 = b;
+
+    return p1->pid < p2->pid ? -1 : p1->pid > p2->pid;
+}
+
+/* Lists the processes that descend from the current process. */
+static size_t
+list_descendants(recorder_state_t *rs, proc_info_t **procs)
+{
+    DIR *dir;
+    struct dirent *entry;
+    proc_info_t *all = NULL;
+    char *selected;
+    size_t n = 0, max = 0, n_selected = 0;
+    pid_t self = getpid();
+    int changed;
+
+    if ( ! (dir = opendir("/proc")) )
+        return 0;
+    while ( (entry = readdir(dir)) ) {
+        if ( entry->d_name[0] < '0' || entry->d_name[0] > '9' )
+            continue;
+        if ( n == max ) {
+            max += 256;
+            all = xrealloc(all, sizeof(proc_info_t) * max);
+        }
+        if ( read_proc_info(rs, atol(entry->d_name), &all[n]) == 0 )
+            n += 1;
+    }
+    closedir(dir);
+    qsort(all, n, sizeof(proc_info_t), compare_pids);
+
+    /* Mark the children of already marked processes, until there is
+     * nothing left to mark. */
+    selected = xmalloc(n + 1);
+    memset(selected, 0, n + 1);
+    do {
+        changed = 0;
+        for ( size_t i = 0; i < n; i++ ) {
+            proc_info_t key, *parent;
+
+            if ( selected[i] )
+                continue;
+            key.pid = all[i].ppid;
+            if ( all[i].ppid == self || ((parent = bsearch(&key, all, n, sizeof(proc_info_t), compare_pids))
+                        && selected[parent - all]) ) {
+                selected[i] = 1;
+                changed = 1;
+            }
+        }
+    } while ( changed );
+
+    for ( size_t i = 0; i < n; i++ )
+        if ( selected[i] )
+            all[n_selected++] = all[i];
+    free(selected);
+
+    *procs = all;
+    return n_selected;
+}
+
+/* Finds the cgroup of the container whose ID is in the specified file.
+ * Returns NULL if the container has not started (or has already
+ * terminated). */
+static char *
+find_container_cgroup(const char *cid_file)
+{
+    char id[128], buffer[4096], *command, *pid, *path = NULL;
+
+    if ( read_small_file(cid_file, id, sizeof(id)) <= 0 )
+        return NULL;
+    id[strspn(id, "0123456789abcdef")] = '\0';
+    if ( ! *id )
+        return NULL;
+
+    xasprintf(&command, "docker inspect --format={{.State.Pid}} %s 2> /dev/null", id);
+    pid = read_line_from_pipe(command);
+    free(command);
+    if ( pid && strcmp(pid, "0") != 0 ) {
+        xasprintf(&command, "/proc/%s/cgroup", pid);
+        if ( read_small_file(command, buffer, sizeof(buffer)) > 0 ) {
+            for ( char *line = strtok(buffer, "\n"); line; line = strtok(NULL, "\n") ) {
+                if ( strncmp(line, "0::", 3) == 0 ) {
+                    xasprintf(&path, "/sys/fs/cgroup%s/memory.current", line + 3);
+                    if ( file_exists(path) == 0 )
+                        *strrchr(path, '/') = '\0';
+                    else {
+                        free(path);
+                        path = NULL;
+                    }
+                }
+            }
+        }
+        free(command);
+    }
+    free(pid);
+
+    return path;
+}
+
+/* Reads the counters of a cgroup. */
+static int
+read_cgroup(recorder_state_t *rs, unsigned long *memory, counters_t *counters)
+{
+    char path[PATH_MAX], buffer[8192], *token, *cursor;
+
+    snprintf(path, sizeof(path), "%s/memory.current", rs->cgroup);
+    if ( read_small_file(path, buffer, sizeof(buffer)) <= 0 )
+        return -1;
+    *memory = strtoull(buffer, NULL, 10) / 1024;
+
+    /* Same as 'docker stats': do not count inactive page cache. */
+    snprintf(path, sizeof(path), "%s/memory.stat", rs->cgroup);
+    if ( read_small_file(path, buffer, sizeof(buffer)) > 0 ) {
+        unsigned long inactive = get_keyed_value(buffer, "inactive_file") / 1024;
+
+        *memory = inactive < *memory ? *memory - inactive : 0;
+    }
+
+    snprintf(path, sizeof(path), "%s/cpu.stat", rs->cgroup);
+    if ( read_small_file(path, buffer, sizeof(buffer)) > 0 )
+        counters->cpu = get_keyed_value(buffer, "usage_usec");
+
+    /* One line per device, with "rbytes=N wbytes=N ..." fields. */
+    snprintf(path, sizeof(path), "%s/io.stat", rs->cgroup);
+    if ( read_small_file(path, buffer, sizeof(buffer)) > 0 ) {
+        for ( token = strtok_r(buffer, " \n", &cursor); token; token = strtok_r(NULL, " \n", &cursor) ) {
+            if ( strncmp(token, "rbytes=", 7) == 0 )
+                counters->read += strtoull(token + 7, NULL, 10);
+            else if ( strncmp(token, "wbytes=", 7) == 0 )
+                counters->written += strtoull(token + 7, NULL, 10);
+        }
+    }
+
+    return 0;
+}
+
+/* Lists the processes of a cgroup. */
+static size_t
+list_cgroup_processes(recorder_state_t *rs, proc_info_t **procs)
+{
+    char path[PATH_MAX];
+    FILE *f;
+    long pid;
+    size_t n = 0, max = 0;
+
+    *procs = NULL;
+    snprintf(path, sizeof(path), "%s/cgroup.procs", rs->cgroup);
+    if ( (f = fopen(path, "r")) ) {
+        while ( fscanf(f, "%ld", &pid) == 1 ) {
+            if ( n == max ) {
+                max += 64;
+                *procs = xrealloc(*procs, sizeof(proc_info_t) * max);
+            }
+            if ( read_proc_info(rs, pid, &(*procs)[n]) == 0 )
+                n += 1;
+        }
+        fclose(f);
+    }
+
+    return n;
+}
+
+/* Gets a short description of what a process is doing. */
+static char *
+describe_process(pid_t pid, const char *comm)
+{
+    char path[64], buffer[4096], *args[64], *desc = NULL;
+    ssize_t len;
+    size_t n = 0;
+
+    snprintf(path, sizeof(path), "/proc/%ld/cmdline", (long)pid);
+    if ( (len = read_small_file(path, buffer, sizeof(buffer))) > 0 ) {
+        for ( char *p = buffer; p < buffer + len && n < 64; p += strlen(p) + 1 )
+            args[n++] = p;
+    }
+
+    if ( strcmp(comm, "java") == 0 ) {
+        /* java [options] -jar /path/to/robot.jar subcommand ... */
+        for ( size_t i = 1; i + 1 < n && ! desc; i++ ) {
+            if ( strcmp(args[i], "-jar") == 0 ) {
+                char *name = strrchr(args[i + 1], '/') ? strrchr(args[i + 1], '/') + 1 : args[i + 1];
+                size_t name_len = strlen(name);
+
+                if ( name_len > 4 && strcmp(name + name_len - 4, ".jar") == 0 )
+                    name_len -= 4;
+                if ( i + 2 < n && args[i + 2][0] != '-' )
+                    xasprintf(&desc, "%.*s %s", (int)name_len, name, args[i + 2]);
+                else
+                    xasprintf(&desc, "%.*s", (int)name_len, name);
+            }
+        }
+    } else if ( strncmp(comm, "python", 6) == 0 ) {
+        /* python [options] /path/to/script|-m module ... */
+        for ( size_t i = 1; i < n && ! desc; i++ ) {
+            if ( strcmp(args[i], "-c") == 0 )
+                break;
+            else if ( strcmp(args[i], "-m") == 0 && i + 1 < n )
+                desc = xstrdup(args[i + 1]);
+            else if ( args[i][0] != '-' )
+                desc = xstrdup(strrchr(args[i], '/') ? strrchr(args[i], '/') + 1 : args[i]);
+        }
+    }
+
+    if ( ! desc )
+        desc = xstrdup(comm);
+    for ( char *p = desc; *p; p++ )
+        if ( (unsigned char)*p < ' ' )
+            *p = ' ';
+
+    return desc;
+}
+
+/* Gets the index of a label, adding it to the table if needed. */
+static size_t
+intern_label(recorder_state_t *rs, char *label)
+{
+    for ( size_t i = 0; i < rs->n_labels; i++ ) {
+        if ( strcmp(rs->labels[i], label) == 0 ) {
+            free(label);
+            return i;
+        }
+    }
+
+    rs->labels = xrealloc(rs->labels, sizeof(char *) * (rs->n_labels + 1));
+    rs->labels[rs->n_labels] = label;
+    return rs->n_labels++;
+}
+
+/* Writes a CSV field, quoted. */
+static void
+write_csv_field(FILE *out, const char *value)
+{
+    fputc('"', out);
+    for ( ; *value; value++ ) {
+        if ( *value == '"' )
+            fputc('"', out);
+        fputc(*value, out);
+    }
+    fputc('"', out);
+}
+
+/* Updates the last known CPU time of the processes, and gets the one
+ * that used the most CPU time since the last sample. */
+static proc_info_t *
+update_processes(recorder_state_t *rs, proc_info_t *procs, size_t n)
+{
+    proc_info_t *busiest = NULL;
+    unsigned long long max_delta = 0;
+    size_t j;
+
+    for ( size_t i = 0; i < rs->n_procs; i++ )
+        rs->procs[i].seen = 0;
+
+    for ( size_t i = 0; i < n; i++ ) {
+        proc_entry_t *entry = NULL;
+        unsigned long long delta;
+
+        for ( j = 0; j < rs->n_procs && ! entry; j++ )
+            if ( rs->procs[j].pid == procs[i].pid )
+                entry = &rs->procs[j];
+        if ( ! entry ) {
+            if ( rs->n_procs == rs->max_procs ) {
+                rs->max_procs += 64;
+                rs->procs = xrealloc(rs->procs, sizeof(proc_entry_t) * rs->max_procs);
+            }
+            entry = &rs->procs[rs->n_procs++];
+            entry->pid = procs[i].pid;
+            entry->cpu = 0;
+        }
+
+        delta = procs[i].cpu > entry->cpu ? procs[i].cpu - entry->cpu : 0;
+        if ( ! busiest || delta > max_delta || (delta == max_delta && procs[i].rss > busiest->rss) ) {
+            busiest = &procs[i];
+            max_delta = delta;
+        }
+        entry->cpu = procs[i].cpu;
+        entry->seen = 1;
+    }
+
+    for ( size_t i = j = 0; i < rs->n_procs; i++ )
+        if ( rs->procs[i].seen )
+            rs->procs[j++] = rs->procs[i];
+    rs->n_procs = j;
+
+    return busiest;
+}
+
+/* Gets the difference between two readings of a counter. Counters may
+ * go backwards when a process that has terminated is not reaped by one
+ * of the processes we look at. */
+static unsigned long long
+get_increase(unsigned long long *last, unsigned long long now)
+{
+    unsigned long long delta = 0;
+
+    if ( now > *last ) {
+        delta = now - *last;
+        *last = now;
+    }
+
+    return delta;
+}
+
+/* Takes a single sample. */
+static void
+take_sample(odk_usage_recorder_t *ur)
+{
+    recorder_state_t *rs = ur->priv;
+    proc_info_t *procs = NULL, *busiest;
+    counters_t now = { 0 };
+    sample_t *sample;
+    unsigned long memory = 0;
+    size_t n;
+    double dt;
+
+    if ( ur->container_id_file ) {
+        if ( ! rs->cgroup && ! (rs->cgroup = find_container_cgroup(ur->container_id_file)) )
+            return;
+        if ( read_cgroup(rs, &memory, &now) == -1 )
+            return;
+        n = list_cgroup_processes(rs, &procs);
+    } else {
+        n = list_descendants(rs, &procs);
+        for ( size_t i = 0; i < n; i++ ) {
+            char path[64], buffer[1024];
+
+            memory += procs[i].rss * rs->page_size;
+            now.cpu += procs[i].cpu_total;
+            snprintf(path, sizeof(path), "/proc/%ld/io", (long)procs[i].pid);
+            if ( read_small_file(path, buffer, sizeof(buffer)) > 0 ) {
+                now.read += get_keyed_value(buffer, "read_bytes:");
+                now.written += get_keyed_value(buffer, "write_bytes:");
+            }
+        }
+    }
+    busiest = update_processes(rs, procs, n);
+
+    if ( n > 0 ) {
+        if ( ur->n_samples == rs->max_samples ) {
+            rs->max_samples = rs->max_samples ? rs->max_samples * 2 : 256;
+            rs->samples = xrealloc(rs->samples, sizeof(sample_t) * rs->max_samples);
+        }
+        sample = &rs->samples[ur->n_samples++];
+        sample->time = get_monotonic_time() - rs->start;
+        sample->memory = memory;
+        dt = sample->time - rs->last_time;
+        sample->cpu = get_increase(&rs->last.cpu, now.cpu) / (dt > 0 ? dt * 10000 : 1);
+        sample->read = get_increase(&rs->last.read, now.read) / 1024;
+        sample->written = get_increase(&rs->last.written, now.written) / 1024;
+        sample->label = intern_label(rs, describe_process(busiest->pid, busiest->comm));
+
+        fprintf(rs->out, "%.2f,%lu,%.1f,%lu,%lu,", sample->time, sample->memory, sample->cpu,
+                sample->read, sample->written);
+        write_csv_field(rs->out, rs->labels[sample->label]);
+        fputc('\n', rs->out);
+        fflush(rs->out);
+
+        rs->last_time = sample->time;
+    }
+
+    free(procs);
+}
+
+static void *
+recorder_thread(void *arg)
+{
+    odk_usage_recorder_t *ur = arg;
+    recorder_state_t *rs = ur->priv;
+    struct pollfd fd;
+    int rc;
+
+    fd.fd = rs->stop_pipe[0];
+    fd.events = POLLIN;
+
+    while ( (rc = poll(&fd, 1, ur->interval)) == 0 || (rc == -1 && errno == EINTR) ) {
+        if ( rc == 0 )
+            take_sample(ur);
+    }
+
+    return NULL;
+}
+
+/* Writes a string with XML special characters escaped. */
+static void
+write_xml_text(FILE *out, const char *text)
+{
+    for ( ; *text; text++ ) {
+        switch ( *text ) {
+        case '&': fputs("&amp;", out); break;
+        case '<': fputs("&lt;", out); break;
+        case '>': fputs("&gt;", out); break;
+        case '"': fputs("&quot;", out); break;
+        default: fputc(*text, out);
+        }
+    }
+}
+
+static double
+get_sample_value(const sample_t *sample, int chart)
+{
+    return chart == 0 ? sample->memory / 1024.0 : sample->cpu;
+}
+
+/* Writes the SVG plot of the samples. */
+static void
+write_svg(odk_usage_recorder_t *ur, FILE *out)
+{
+    static const char *palette[] = {
+        "#dbe9f6", "#fde0c5", "#d9f0d3", "#f2d7ee",
+        "#fff3b0", "#d7eef0", "#eadfd4", "#e3e3f3"
+    };
+    recorder_state_t *rs = ur->priv;
+    double duration, max[2] = { 1, 100 }, cpu_time = 0;
+    int height = 40 + 2 * (SVG_CHART + SVG_GAP);
+
+    duration = rs->samples[ur->n_samples - 1].time;
+    if ( duration <= 0 )
+        duration = 1;
+    for ( size_t i = 0; i < ur->n_samples; i++ ) {
+        for ( int c = 0; c < 2; c++ )
+            if ( get_sample_value(&rs->samples[i], c) > max[c] )
+                max[c] = get_sample_value(&rs->samples[i], c);
+        cpu_time += rs->samples[i].cpu / 100 * (rs->samples[i].time - (i > 0 ? rs->samples[i - 1].time : 0));
+    }
+    max[1] = ((int)(max[1] + 99) / 100) * 100;
+
+#define X(t) (SVG_LEFT + (t) / duration * (SVG_RIGHT - SVG_LEFT))
+
+    fprintf(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" "
+            "font-family=\"sans-serif\" font-size=\"11\">\n"
+            "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n"
+            "<text x=\"%d\" y=\"20\" font-size=\"14\">Resource usage: peak memory %.0f MB, "
+            "CPU time %.0f s, duration %.0f s</text>\n",
+            SVG_WIDTH, height, SVG_LEFT, max[0], cpu_time, duration);
+
+    for ( int c = 0; c < 2; c++ ) {
+        int top = 40 + c * (SVG_CHART + SVG_GAP), bottom = top + SVG_CHART;
+        size_t i, j;
+
+        /* One band per run of samples with the same label. */
+        for ( i = 0; i < ur->n_samples; i = j ) {
+            double from = i > 0 ? rs->samples[i - 1].time : 0, to;
+            const char *label = rs->labels[rs->samples[i].label];
+
+            for ( j = i + 1; j < ur->n_samples && rs->samples[j].label == rs->samples[i].label; j++ ) ;
+            to = rs->samples[j - 1].time;
+
+            fprintf(out, "<rect x=\"%.1f\" y=\"%d\" width=\"%.1f\" height=\"%d\" fill=\"%s\"><title>",
+                    X(from), top, X(to) - X(from), SVG_CHART, palette[rs->samples[i].label % 8]);
+            write_xml_text(out, label);
+            fprintf(out, " (%.0f s)</title></rect>\n", to - from);
+            if ( c == 0 && X(to) - X(from) > 6.5 * strlen(label) + 4 ) {
+                fprintf(out, "<text x=\"%.1f\" y=\"%d\" fill=\"#555\">", X(from) + 2, top + 12);
+                write_xml_text(out, label);
+                fputs("</text>\n", out);
+            }
+        }
+
+        fprintf(out, "<polyline fill=\"none\" stroke=\"%s\" stroke-width=\"1.5\" points=\"",
+                c == 0 ? "#1f77b4" : "#d62728");
+        for ( i = 0; i < ur->n_samples; i++ )
+            fprintf(out, "%s%.1f,%.1f", i > 0 ? " " : "", X(rs->samples[i].time),
+                    bottom - get_sample_value(&rs->samples[i], c) / max[c] * SVG_CHART);
+        fputs("\"/>\n", out);
+
+        fprintf(out, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"none\" stroke=\"#888\"/>\n"
+                "<text x=\"%d\" y=\"%d\" text-anchor=\"end\">%.0f %s</text>\n"
+                "<text x=\"%d\" y=\"%d\" text-anchor=\"end\">0</text>\n"
+                "<text x=\"%d\" y=\"%d\" font-size=\"12\">%s</text>\n",
+                SVG_LEFT, top, SVG_RIGHT - SVG_LEFT, SVG_CHART,
+                SVG_LEFT - 4, top + 10, max[c], c == 0 ? "MB" : "%",
+                SVG_LEFT - 4, bottom,
+                SVG_LEFT, top - 4, c == 0 ? "Memory" : "CPU (100% = one CPU)");
+        for ( int k = 0; k <= 5; k++ )
+            fprintf(out, "<text x=\"%.1f\" y=\"%d\" text-anchor=\"middle\">%.0f s</text>\n",
+                    X(duration * k / 5), bottom + 14, duration * k / 5);
+    }
+
+#undef X
+
+    fputs("</svg>\n", out);
+}
+
+/* Releases the resources of a recorder. */
+static void
+free_state(recorder_state_t *rs)
+{
+    if ( rs->out )
+        fclose(rs->out);
+    close(rs->stop_pipe[0]);
+    if ( rs->stop_pipe[1] != -1 )
+        close(rs->stop_pipe[1]);
+    for ( size_t i = 0; i < rs->n_labels; i++ )
+        free(rs->labels[i]);
+    free(rs->labels);
+    free(rs->samples);
+    free(rs->procs);
+    free(rs->cgroup);
+    free(rs);
+}
+
+#endif /* ODK_USAGE_SUPPORTED */
+
+/**
+ * Starts recording the resources used by a command. This function
+ * returns immediately, while samples are taken in the background and
+ * written to the output file as they are taken.
+ *
+ * @param ur        The recorder object to initialise.
+ * @param filename  The CSV file to write.
+ * @param container If non-zero, record a Docker container, whose ID
+ *                  must be written by Docker to the file indicated by
+ *                  the 'container_id_file' field of the recorder;
+ *                  otherwise, record the processes started by the
+ *                  current process.
+ * @param interval  The interval between two samples, in milliseconds
+ *                  (0 to use ODK_USAGE_DEFAULT_INTERVAL).
+ *
+ * @return 0 if successful, or -1 if an error occured (check errno for
+ *         details).
+ */
+int
+odk_usage_recorder_start(odk_usage_recorder_t *ur, const char *filename, int container,
+                         unsigned interval)
+{
+    memset(ur, 0, sizeof(odk_usage_recorder_t));
+
+#if defined(ODK_USAGE_SUPPORTED)
+    recorder_state_t *rs;
+
+    rs = xmalloc(sizeof(recorder_state_t));
+    memset(rs, 0, sizeof(recorder_state_t));
+    if ( pipe(rs->stop_pipe) == -1 ) {
+        free(rs);
+        return -1;
+    }
+    if ( ! (rs->out = fopen(filename, "w")) ) {
+        free_state(rs);
+        return -1;
+    }
+    fprintf(rs->out, "time_s,memory_kb,cpu_percent,read_kb,written_kb,command\n");
+
+    rs->ticks = sysconf(_SC_CLK_TCK);
+    rs->page_size = sysconf(_SC_PAGESIZE) / 1024;
+    rs->start = get_monotonic_time();
+
+    ur->priv = rs;
+    ur->filename = xstrdup(filename);
+    if ( container ) {
+        const char *tmpdir = getenv("TMPDIR");
+
+        /* Docker refuses to overwrite an existing file. */
+        xasprintf(&ur->container_id_file, "%s/odkrun-%ld.cid", tmpdir ? tmpdir : "/tmp", (long)getpid());
+        unlink(ur->container_id_file);
+    }
+    ur->interval = interval ? interval : ODK_USAGE_DEFAULT_INTERVAL;
+
+    if ( pthread_create(&rs->thread, NULL, recorder_thread, ur) != 0 ) {
+        odk_usage_recorder_finish(ur);
+        return -1;
+    }
+    rs->running = 1;
+
+    return 0;
+#else
+    (void) filename;
+    (void) container;
+    (void) interval;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * Stops recording resource usage, writes a SVG plot of the samples
+ * next to the CSV file, and releases all associated resources
+ * (including the container ID file).
+ *
+ * @param ur The recorder object.
+ *
+ * @return 0 if successful, or -1 if an error occured when writing the
+ *         output files (check errno for details).
+ */
+int
+odk_usage_recorder_finish(odk_usage_recorder_t *ur)
+{
+    int ret = 0;
+#if defined(ODK_USAGE_SUPPORTED)
+    recorder_state_t *rs = ur->priv;
+    char *svg_file, *ext;
+    FILE *f;
+
+    if ( rs ) {
+        if ( rs->running ) {
+            /* Closing the pipe wakes up the thread. */
+            close(rs->stop_pipe[1]);
+            rs->stop_pipe[1] = -1;
+            pthread_join(rs->thread, NULL);
+        }
+
+        if ( fclose(rs->out) == EOF )
+            ret = -1;
+        rs->out = NULL;
+
+        if ( ur->n_samples > 0 ) {
+            if ( (ext = strrchr(ur->filename, '.')) && strcmp(ext, ".csv") == 0 )
+                xasprintf(&svg_file, "%.*s.svg", (int)(ext - ur->filename), ur->filename);
+            else
+                xasprintf(&svg_file, "%s.svg", ur->filename);
+            if ( (f = fopen(svg_file, "w")) ) {
+                write_svg(ur, f);
+                if ( fclose(f) == EOF )
+                    ret = -1;
+            } else
+                ret = -1;
+            free(svg_file);
+        }
+
+        free_state(rs);
+        ur->priv = NULL;
+
+        if ( ur->container_id_file )
+            unlink(ur->container_id_file);
+    }
+#endif
+
+    free(ur->filename);
+    free(ur->container_id_file);
+    ur->filename = ur->container_id_file = NULL;
+
+    return ret;
+}
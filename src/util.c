@@ -38,19 +38,25 @@
 #include <errno.h>
 #include <assert.h>
 #include <dirent.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
 #if defined(ODK_RUNNER_LINUX)
 #include <sys/sysinfo.h>
+#include <sys/utsname.h>
+#include <unistd.h>
 #include <fnmatch.h>
 
 #elif defined(ODK_RUNNER_MACOS)
 #include <sys/sysctl.h>
+#include <sys/utsname.h>
+#include <unistd.h>
 #include <fnmatch.h>
 
 #elif defined(ODK_RUNNER_WINDOWS)
 #include <windows.h>
+#include <direct.h>
 
 #endif
 
@@ -92,6 +98,136 @@ get_physical_memory(void)
     return phys_mem;
 }
 
+/**
+ * Gets the amount of memory that processes started by the current
+ * process are allowed to use. This is the amount of physical memory,
+ * unless the current process is constrained by a lower limit (on
+ * GNU/Linux, the memory limit of its control group).
+ *
+ * @return The memory limit (in bytes), or 0 if we couldn't get that
+ *         information.
+ */
+size_t
+get_memory_limit(void)
+{
+    size_t limit = get_physical_memory();
+
+#if defined(ODK_RUNNER_LINUX)
+    FILE *f;
+
+    if ( (f = fopen("/proc/self/cgroup", "r")) ) {
+        char *line = NULL, *path;
+        size_t n = 0;
+        ssize_t len;
+
+        while ( (len = getline(&line, &n, f)) != -1 ) {
+            FILE *m;
+            unsigned long long max;
+
+            /* Only consider the unified (v2) hierarchy. */
+            if ( strncmp(line, "0::", 3) != 0 )
+                continue;
+
+            if ( line[len - 1] == '\n' )
+                line[len - 1] = '\0';
+
+            xasprintf(&path, "/sys/fs/cgroup%s/memory.max", line + 3);
+            if ( (m = fopen(path, "r")) ) {
+                /* The limit may be "max", which means no limit. */
+                if ( fscanf(m, "%llu", &max) == 1 && (limit == 0 || max < limit) )
+                    limit = max;
+                fclose(m);
+            }
+            free(path);
+        }
+
+        free(line);
+        fclose(f);
+    }
+#endif
+
+    return limit;
+}
+
+/**
+ * Gets the number of processors available.
+ *
+ * @return The number of online processors, or 1 if we couldn't get
+ *         that information.
+ */
+unsigned
+get_cpu_count(void)
+{
+    long n = 1;
+
+#if defined(ODK_RUNNER_WINDOWS)
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    n = info.dwNumberOfProcessors;
+#else
+    if ( (n = sysconf(_SC_NPROCESSORS_ONLN)) < 1 )
+        n = 1;
+#endif
+
+    return n;
+}
+
+/**
+ * Gets the name of the hardware architecture of the system.
+ *
+ * @param buffer The buffer to store the name into.
+ * @param len    The size of the buffer.
+ *
+ * @return 0 if successful, or -1 if we couldn't get that information.
+ */
+int
+get_machine_arch(char *buffer, size_t len)
+{
+    int ret = -1;
+
+#if defined(ODK_RUNNER_WINDOWS)
+    SYSTEM_INFO info;
+    const char *arch = NULL;
+
+    GetNativeSystemInfo(&info);
+    if ( info.wProcessorArchitecture == PROCESSOR_ARCHITECTURE_AMD64 )
+        arch = "x86_64";
+    else if ( info.wProcessorArchitecture == PROCESSOR_ARCHITECTURE_ARM64 )
+        arch = "arm64";
+
+    if ( arch && (size_t) snprintf(buffer, len, "%s", arch) < len )
+        ret = 0;
+#else
+    struct utsname un;
+
+    if ( uname(&un) != -1 && (size_t) snprintf(buffer, len, "%s", un.machine) < len )
+        ret = 0;
+#endif
+
+    return ret;
+}
+
+/**
+ * Gets the current time from a monotonic clock.
+ *
+ * @return The current time, in seconds from an arbitrary (but fixed)
+ *         point in the past.
+ */
+double
+get_monotonic_time(void)
+{
+#if defined(ODK_RUNNER_WINDOWS)
+    return GetTickCount64() / 1000.0;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+}
+
 /**
  * Checks if the specified file exists.
  *
@@ -248,3 +384,68 @@ read_line_from_pipe(const char *command)
 
     return line;
 }
+
+/**
+ * Creates a directory, along with any missing parent directory.
+ *
+ * @param path The directory to create.
+ *
+ * @return 0 if successful (including if the directory already
+ *         existed), or -1 if an error occured (check errno for details).
+ */
+int
+create_directory(const char *path)
+{
+    char *copy, *p;
+    int ret = 0;
+
+    assert(path != NULL);
+
+    copy = xstrdup(path);
+    for ( p = copy + 1; ret == 0 && *p; p++ ) {
+        if ( *p == '/' ) {
+            *p = '\0';
+#if defined(ODK_RUNNER_WINDOWS)
+            if ( mkdir(copy) == -1 && errno != EEXIST )
+#else
+            if ( mkdir(copy, 0755) == -1 && errno != EEXIST )
+#endif
+                ret = -1;
+            *p = '/';
+        }
+    }
+
+#if defined(ODK_RUNNER_WINDOWS)
+    if ( ret == 0 && mkdir(copy) == -1 && errno != EEXIST )
+#else
+    if ( ret == 0 && mkdir(copy, 0755) == -1 && errno != EEXIST )
+#endif
+        ret = -1;
+
+    free(copy);
+
+    return ret;
+}
+
+/**
+ * Updates a 64-bit FNV-1a hash with new data.
+ *
+ * @param hash The current value of the hash (FNV1A_INIT for a new
+ *             hash).
+ * @param data The data to add to the hash.
+ * @param len  The length of the data.
+ *
+ * @return The updated hash value.
+ */
+unsigned long long
+hash_fnv1a(unsigned long long hash, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    while ( len-- > 0 ) {
+        hash ^= *p++;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
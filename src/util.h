@@ -34,6 +34,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+/* Initial value for hash_fnv1a. */
+#define FNV1A_INIT  0xcbf29ce484222325ULL
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -56,6 +59,24 @@ read_file(const char *, size_t *, size_t);
 char *
 read_line_from_pipe(const char *);
 
+int
+create_directory(const char *);
+
+double
+get_monotonic_time(void);
+
+unsigned
+get_cpu_count(void);
+
+int
+get_machine_arch(char *, size_t);
+
+size_t
+get_memory_limit(void);
+
+unsigned long long
+hash_fnv1a(unsigned long long, const void *, size_t);
+
 #ifdef __cplusplus
 }
 #endif